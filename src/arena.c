@@ -2,19 +2,43 @@
 /* arena.h: a simple bump allocator for managing memory */
 /* Credit to skeeto and his blogs for inspiring this  */
 
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // for MAP_ANONYMOUS, MAP_NORESERVE and madvise
+#endif                  /* ifndef _DEFAULT_SOURCE */
+
 #include <assert.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
+#include <sys/mman.h>
+
+#ifdef ARENA_STATS
+#include <stdatomic.h>
+#endif /* ARENA_STATS */
 
 #include "arena.h"
 
+#if defined(__SANITIZE_ADDRESS__)
+#define ARENA_ASAN__ 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ARENA_ASAN__ 1
+#endif
+#endif
+
+#if defined(ARENA_DEBUG) && defined(ARENA_ASAN__)
+#include <sanitizer/asan_interface.h>
+#define arena_unpoison_range__(start, end) ASAN_UNPOISON_MEMORY_REGION(start, (size_t)((end) - (start)))
+#else
+#define arena_unpoison_range__(start, end)
+#endif /* ARENA_DEBUG && ARENA_ASAN__ */
+
 void arena_abort__()
 {
     puts("ncsh: ran out of allocated memory.");
-    // TODO: implement different OOM stragety other than aborting.
+    // only fixed arenas and growable arenas whose source is out of memory get here
     fprintf(stderr, "\nncsh: out of memory, aborting.\n");
     abort();
 }
@@ -26,29 +50,572 @@ void arena_abort_set(void (*abort_func)())
     arena_abort_fn__= abort_func;
 }
 
+struct Arena_Block {
+    Arena_Block* next;
+    Arena_Block* head; // first block of the chain, kept by arena_reset
+    char* end;         // end of the committed pages for reserved arenas
+    char* reserve_end; // NULL for chained arenas
+};
+
+static void* (*arena_allocate_fn__)(size_t) = malloc;
+static void (*arena_release_fn__)(void*) = free;
+
+void arena_source_set(void* (*allocate)(size_t), void (*release)(void*))
+{
+    assert(allocate && release);
+    arena_allocate_fn__ = allocate;
+    arena_release_fn__ = release;
+}
+
+static inline char* arena_block_start__(Arena_Block* restrict block)
+{
+    return (char*)(block + 1);
+}
+
+static Arena_Block* arena_block_new__(Arena_Block* restrict head, uintptr_t size)
+{
+    if (size > SIZE_MAX - sizeof(Arena_Block)) {
+        return NULL;
+    }
+    Arena_Block* block = arena_allocate_fn__(sizeof(Arena_Block) + size);
+    if (!block) {
+        return NULL;
+    }
+    *block = (Arena_Block){.head = head ? head : block, .end = arena_block_start__(block) + size};
+    return block;
+}
+
+static void arena_blocks_release__(Arena_Block* restrict block)
+{
+    while (block) {
+        Arena_Block* next = block->next;
+        arena_unpoison_range__(arena_block_start__(block), block->end);
+        arena_release_fn__(block);
+        block = next;
+    }
+}
+
+static inline void arena_block_use__(Arena* restrict arena, Arena_Block* restrict block)
+{
+    *arena = (Arena){.start = arena_block_start__(block), .end = block->end, .block = block};
+}
+
+#ifdef ARENA_STATS
+// call sites past this many are counted together, named arenas past this many aren't tracked
+#ifndef ARENA_STATS_SITES
+#define ARENA_STATS_SITES 512
+#endif /* !ARENA_STATS_SITES */
+#ifndef ARENA_STATS_ARENAS
+#define ARENA_STATS_ARENAS 8
+#endif /* !ARENA_STATS_ARENAS */
+
+typedef struct {
+    Arena_Site site;
+    uintptr_t count;
+    uintptr_t bytes;
+    uintptr_t padding;
+} Arena_Stats_Site;
+
+/* Arena_Stats_Arena
+ * A named arena. Positions are found by walking its blocks from head, or by range for a fixed arena.
+ */
+typedef struct {
+    const char* name;
+    Arena_Block* head; // NULL for fixed arenas
+    char* base;
+    char* end;
+    uintptr_t used;
+    uintptr_t high_water;
+    bool freed;
+} Arena_Stats_Arena;
+
+static struct {
+    atomic_flag lock; // the database loads on another thread while the main thread probes with scratch
+    bool reported;
+    Arena_Stats_Site sites[ARENA_STATS_SITES];
+    Arena_Stats_Site other;
+    Arena_Stats_Arena arenas[ARENA_STATS_ARENAS];
+    size_t arenas_count;
+} arena_stats__ = {.lock = ATOMIC_FLAG_INIT, .other = {.site = {.file = "other", .line = 0}}};
+
+static inline void arena_stats_lock__(void)
+{
+    while (atomic_flag_test_and_set_explicit(&arena_stats__.lock, memory_order_acquire)) {
+    }
+}
+
+static inline void arena_stats_unlock__(void)
+{
+    atomic_flag_clear_explicit(&arena_stats__.lock, memory_order_release);
+}
+
+/* arena_stats_used__
+ * Bytes from the start of a named arena to position, false if position isn't in it.
+ */
+static bool arena_stats_used__(Arena_Stats_Arena* restrict stats, char* position, uintptr_t* restrict used)
+{
+    if (!stats->head) {
+        if (position < stats->base || position > stats->end) {
+            return false;
+        }
+        *used = (uintptr_t)(position - stats->base);
+        return true;
+    }
+
+    uintptr_t before = 0;
+    for (Arena_Block* block = stats->head; block; block = block->next) {
+        char* start = arena_block_start__(block);
+        char* end = block->reserve_end ? block->reserve_end : block->end;
+        if (position >= start && position <= end) {
+            *used = before + (uintptr_t)(position - start);
+            return true;
+        }
+        before += (uintptr_t)(block->end - start);
+    }
+    return false;
+}
+
+static void arena_stats_update_locked__(Arena* restrict arena)
+{
+    for (size_t i = 0; i < arena_stats__.arenas_count; ++i) {
+        Arena_Stats_Arena* stats = arena_stats__.arenas + i;
+        uintptr_t used;
+        if (!stats->freed && arena_stats_used__(stats, arena->start, &used)) {
+            stats->used = used;
+            if (used > stats->high_water) {
+                stats->high_water = used;
+            }
+            return;
+        }
+    }
+}
+
+void arena_stats_update__(Arena* restrict arena)
+{
+    arena_stats_lock__();
+    arena_stats_update_locked__(arena);
+    arena_stats_unlock__();
+}
+
+static void arena_stats_record__(Arena* restrict arena, Arena_Site site, uintptr_t bytes, uintptr_t padding)
+{
+    arena_stats_lock__();
+    size_t hash = ((uintptr_t)site.file >> 4) * 31 + (size_t)site.line;
+    Arena_Stats_Site* entry = &arena_stats__.other;
+    for (size_t i = 0; i < ARENA_STATS_SITES; ++i) {
+        Arena_Stats_Site* slot = arena_stats__.sites + (hash + i) % ARENA_STATS_SITES;
+        if (!slot->site.file) {
+            slot->site = site;
+        }
+        // __FILE__ is the same literal for every site in a file, but compare the contents in case it isn't merged
+        if (slot->site.line == site.line && (slot->site.file == site.file || !strcmp(slot->site.file, site.file))) {
+            entry = slot;
+            break;
+        }
+    }
+    ++entry->count;
+    entry->bytes += bytes;
+    entry->padding += padding;
+    arena_stats_update_locked__(arena);
+    arena_stats_unlock__();
+}
+
+/* arena_stats_free__
+ * Stop tracking the named arenas living in blocks which are about to be released, keeping their numbers.
+ */
+static void arena_stats_free__(Arena* restrict arena)
+{
+    arena_stats_lock__();
+    arena_stats_update_locked__(arena);
+    for (size_t i = 0; i < arena_stats__.arenas_count; ++i) {
+        Arena_Stats_Arena* stats = arena_stats__.arenas + i;
+        if (arena->block && stats->head == arena->block->head) {
+            stats->freed = true;
+        }
+    }
+    arena_stats_unlock__();
+}
+
+static void arena_stats_exit__(void)
+{
+    if (!arena_stats__.reported) {
+        arena_stats_report(stderr);
+    }
+}
+
+void arena_stats_name(Arena* restrict arena, const char* name)
+{
+    assert(arena && name);
+    arena_stats_lock__();
+    if (!arena_stats__.arenas_count) {
+        atexit(arena_stats_exit__);
+    }
+    if (arena_stats__.arenas_count < ARENA_STATS_ARENAS) {
+        arena_stats__.arenas[arena_stats__.arenas_count++] =
+            (Arena_Stats_Arena){.name = name,
+                                .head = arena->block ? arena->block->head : NULL,
+                                .base = arena->block ? arena_block_start__(arena->block->head) : arena->start,
+                                .end = arena->end};
+        arena_stats_update_locked__(arena);
+    }
+    arena_stats_unlock__();
+}
+
+uintptr_t arena_stats_allocations(void)
+{
+    arena_stats_lock__();
+    uintptr_t count = arena_stats__.other.count;
+    for (size_t i = 0; i < ARENA_STATS_SITES; ++i) {
+        count += arena_stats__.sites[i].count;
+    }
+    arena_stats_unlock__();
+    return count;
+}
+
+static int arena_stats_site_compare__(const void* left, const void* right)
+{
+    uintptr_t left_bytes = ((const Arena_Stats_Site*)left)->bytes + ((const Arena_Stats_Site*)left)->padding;
+    uintptr_t right_bytes = ((const Arena_Stats_Site*)right)->bytes + ((const Arena_Stats_Site*)right)->padding;
+    return (left_bytes < right_bytes) - (left_bytes > right_bytes);
+}
+
+void arena_stats_report(FILE* restrict out)
+{
+    assert(out);
+    arena_stats_lock__();
+    arena_stats__.reported = true;
+
+    fprintf(out, "%-32s %12s %12s\n", "arena", "high water", "in use");
+    for (size_t i = 0; i < arena_stats__.arenas_count; ++i) {
+        Arena_Stats_Arena* stats = arena_stats__.arenas + i;
+        fprintf(out, "%-32s %12zu %12zu%s\n", stats->name, (size_t)stats->high_water, (size_t)stats->used,
+                stats->freed ? " (when freed)" : "");
+    }
+
+    // most bytes first
+    Arena_Stats_Site sites[ARENA_STATS_SITES + 1];
+    size_t count = 0;
+    for (size_t i = 0; i < ARENA_STATS_SITES; ++i) {
+        if (arena_stats__.sites[i].count) {
+            sites[count++] = arena_stats__.sites[i];
+        }
+    }
+    if (arena_stats__.other.count) {
+        sites[count++] = arena_stats__.other;
+    }
+    arena_stats_unlock__();
+    qsort(sites, count, sizeof(Arena_Stats_Site), arena_stats_site_compare__);
+
+    fprintf(out, "\n%-32s %12s %12s %12s\n", "call site", "allocations", "bytes", "padding");
+    char location[256];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(location, sizeof(location), "%s:%d", sites[i].site.file, sites[i].site.line);
+        fprintf(out, "%-32s %12zu %12zu %12zu\n", location, (size_t)sites[i].count, (size_t)sites[i].bytes,
+                (size_t)sites[i].padding);
+    }
+    fflush(out);
+}
+
+#define ARENA_SITE_ARG__ , site
+#else
+#define ARENA_SITE_ARG__
+
+void arena_stats_report(FILE* restrict out)
+{
+    assert(out);
+    fputs("arena: built without ARENA_STATS, rebuild with -DARENA_STATS for allocation stats.\n", out);
+}
+#endif /* ARENA_STATS */
+
+bool arena_chain_new(Arena* restrict arena, uintptr_t size)
+{
+    assert(arena && size);
+    Arena_Block* block = arena_block_new__(NULL, size);
+    if (!block) {
+        return false;
+    }
+    arena_block_use__(arena, block);
+    return true;
+}
+
+static bool arena_commit__(char* restrict start, char* restrict end)
+{
+    if (mprotect(start, (size_t)(end - start), PROT_READ | PROT_WRITE)) {
+        return false;
+    }
+#ifdef MADV_POPULATE_WRITE
+    // fault the pages in with one call rather than one fault per page, older kernels just take the faults
+    madvise(start, (size_t)(end - start), MADV_POPULATE_WRITE);
+#endif /* MADV_POPULATE_WRITE */
+    return true;
+}
+
+bool arena_reserve_new(Arena* restrict arena, uintptr_t size)
+{
+    assert(arena && size);
+    if (size > UINTPTR_MAX - ARENA_COMMIT_SIZE) {
+        return false;
+    }
+    size = (size + ARENA_COMMIT_SIZE - 1) & ~(uintptr_t)(ARENA_COMMIT_SIZE - 1);
+
+    char* reservation = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED) {
+        return false;
+    }
+    if (!arena_commit__(reservation, reservation + ARENA_COMMIT_SIZE)) {
+        munmap(reservation, size);
+        return false;
+    }
+
+    Arena_Block* block = (Arena_Block*)reservation;
+    *block = (Arena_Block){.head = block, .end = reservation + ARENA_COMMIT_SIZE, .reserve_end = reservation + size};
+    arena_block_use__(arena, block);
+    return true;
+}
+
+void arena_trim(Arena* restrict arena)
+{
+    assert(arena);
+    Arena_Block* block = arena->block;
+    if (!block) {
+        return;
+    }
+
+    if (!block->reserve_end) {
+        arena_blocks_release__(block->next);
+        block->next = NULL;
+        return;
+    }
+
+    uintptr_t offset = (uintptr_t)(arena->start - (char*)block);
+    if (offset < ARENA_COMMIT_SIZE) {
+        offset = ARENA_COMMIT_SIZE;
+    }
+    char* keep = (char*)block + ((offset + ARENA_COMMIT_SIZE - 1) & ~(uintptr_t)(ARENA_COMMIT_SIZE - 1));
+    if (block->end > keep) {
+        // the pages stay committed, the kernel hands back zeroed ones when they're next touched
+        arena_unpoison_range__(keep, block->end);
+        madvise(keep, (size_t)(block->end - keep), MADV_DONTNEED);
+    }
+}
+
+void arena_reset(Arena* restrict arena)
+{
+    assert(arena);
+    if (!arena->block) {
+        return;
+    }
+
+    arena_block_use__(arena, arena->block->head);
+    arena_trim(arena);
+#ifdef ARENA_STATS
+    arena_stats_update__(arena);
+#endif /* ARENA_STATS */
+}
+
+void arena_free(Arena* restrict arena)
+{
+    assert(arena);
+#ifdef ARENA_STATS
+    arena_stats_free__(arena);
+#endif /* ARENA_STATS */
+    if (arena->block && arena->block->reserve_end) {
+        Arena_Block* head = arena->block->head;
+        arena_unpoison_range__(arena_block_start__(head), head->end);
+        munmap(head, (size_t)(head->reserve_end - (char*)head));
+    }
+    else if (arena->block) {
+        arena_blocks_release__(arena->block->head);
+    }
+    *arena = (Arena){0};
+}
+
+/* arena_commit_grow__
+ * Commit enough of a reserved arena's pages for needed more bytes. Copies of the arena share the committed pages, so
+ * a copy may find a callee already committed them.
+ */
+static void arena_commit_grow__(Arena* restrict arena, uintptr_t needed)
+{
+    Arena_Block* block = arena->block;
+    if (needed > (uintptr_t)(block->reserve_end - arena->start)) {
+        arena_abort_fn__();
+        return;
+    }
+
+    uintptr_t offset = (uintptr_t)(arena->start - (char*)block) + needed;
+    char* end = (char*)block + ((offset + ARENA_COMMIT_SIZE - 1) & ~(uintptr_t)(ARENA_COMMIT_SIZE - 1));
+    if (end > block->end) {
+        if (end > block->reserve_end) {
+            end = block->reserve_end;
+        }
+        if (!arena_commit__(block->end, end)) {
+            arena_abort_fn__();
+            return;
+        }
+        block->end = end;
+    }
+    arena->end = block->end;
+}
+
+/* arena_grow__
+ * Move a growable arena on to a block with room for size bytes at alignment. Blocks after the current one were
+ * chained by copies of the arena which have gone out of scope, so the first of those with room is reused before
+ * chaining a new block.
+ */
+static void arena_grow__(Arena* restrict arena, uintptr_t size, uintptr_t alignment)
+{
+    uintptr_t needed = size + alignment;
+    Arena_Block* block = arena->block;
+    if (block->reserve_end) {
+        arena_commit_grow__(arena, needed);
+        return;
+    }
+
+    while (block->next) {
+        block = block->next;
+        if ((uintptr_t)(block->end - arena_block_start__(block)) >= needed) {
+            arena_block_use__(arena, block);
+            return;
+        }
+    }
+
+    uintptr_t capacity = (uintptr_t)(block->end - arena_block_start__(block));
+    capacity = capacity > UINTPTR_MAX / 2 ? UINTPTR_MAX : capacity * 2;
+    Arena_Block* next = arena_block_new__(block->head, capacity > needed ? capacity : needed);
+    if (!next) {
+        arena_abort_fn__();
+        return;
+    }
+    block->next = next;
+    arena_block_use__(arena, next);
+}
+
+void arena_ensure(Arena* restrict arena, uintptr_t size)
+{
+    assert(arena);
+    if (arena->block && (uintptr_t)(arena->end - arena->start) < size) {
+        arena_grow__(arena, size, 1);
+    }
+}
+
+static inline void* arena_bump__(Arena* restrict arena, uintptr_t count, uintptr_t size,
+                                 uintptr_t alignment ARENA_SITE_PARAM__)
+{
+    uintptr_t padding = -(uintptr_t)arena->start & (alignment - 1);
+    uintptr_t available = (uintptr_t)arena->end - (uintptr_t)arena->start;
+    if (padding >= available || count > (available - padding) / size) {
+        if (!arena->block || count > (UINTPTR_MAX - alignment) / size) {
+            arena_abort_fn__();
+        }
+        arena_grow__(arena, count * size, alignment);
+        padding = -(uintptr_t)arena->start & (alignment - 1);
+    }
+    void* val = arena->start + padding;
+    arena->start += padding + count * size;
+    arena_unpoison_range__((char*)val, arena->start);
+#ifdef ARENA_STATS
+    arena_stats_record__(arena, site, count * size, padding);
+#endif /* ARENA_STATS */
+    return val;
+}
+
+#ifdef ARENA_DEBUG
+#define ARENA_POISON 0xa5
+
+static void arena_poison_range__(char* restrict start, char* restrict end)
+{
+    if (end <= start) {
+        return;
+    }
+#ifdef ARENA_ASAN__
+    ASAN_POISON_MEMORY_REGION(start, (size_t)(end - start));
+#else
+    memset(start, ARENA_POISON, (size_t)(end - start));
+#endif /* ARENA_ASAN__ */
+}
+
+/* arena_poison__
+ * Poison everything allocated between mark and where the arena is up to now, including whole blocks chained since.
+ */
+void arena_poison__(Arena* restrict arena, Arena_Mark mark)
+{
+    assert(arena);
+    if (mark.block == arena->block) {
+        assert(mark.start <= arena->start && "arena restored to a mark made after where it is up to");
+        arena_poison_range__(mark.start, arena->start);
+        return;
+    }
+
+    arena_poison_range__(mark.start, mark.end);
+    for (Arena_Block* block = mark.block ? mark.block->next : NULL; block && block != arena->block;
+         block = block->next) {
+        arena_poison_range__(arena_block_start__(block), block->end);
+    }
+    if (arena->block) {
+        arena_poison_range__(arena_block_start__(arena->block), arena->start);
+    }
+}
+#else
+#define arena_poison_range__(start, end)
+#endif /* ARENA_DEBUG */
+
 [[nodiscard]]
 __attribute_malloc__
 __attribute_alloc_align__((4))
 void* arena_malloc__(Arena* restrict arena, uintptr_t count, uintptr_t size,
-                            uintptr_t alignment)
+                            uintptr_t alignment ARENA_SITE_PARAM__)
 {
     assert(arena && count && size && alignment);
-    uintptr_t padding = -(uintptr_t)arena->start & (alignment - 1);
-    uintptr_t available = (uintptr_t)arena->end - (uintptr_t)arena->start - padding;
-    assert(count < available / size);
-    if (available == 0 || count > available / size) {
-        arena_abort_fn__();
+    return memset(arena_bump__(arena, count, size, alignment ARENA_SITE_ARG__), 0, count * size);
+}
+
+/* arena_resize_last__
+ * Grow or shrink old_ptr where it is if it's the most recent allocation and the arena has room.
+ * Returns: false if old_ptr has to move.
+ */
+static bool arena_resize_last__(Arena* restrict arena, uintptr_t count, uintptr_t size, char* restrict old_ptr,
+                                uintptr_t old_count ARENA_SITE_PARAM__)
+{
+    char* old_end = old_ptr + old_count * size;
+    if (old_end != arena->start) {
+        return false;
     }
-    void* val = arena->start + padding;
-    arena->start += padding + count * size;
-    return memset(val, 0, count * size);
+
+    if (count <= old_count) {
+        arena->start = old_ptr + count * size;
+        arena_poison_range__(arena->start, old_end);
+#ifdef ARENA_STATS
+        arena_stats_update__(arena);
+#endif /* ARENA_STATS */
+        return true;
+    }
+
+    if (count > UINTPTR_MAX / size) {
+        return false;
+    }
+    uintptr_t room = (uintptr_t)(arena->end - old_ptr);
+    if (count > room / size && arena->block && arena->block->reserve_end &&
+        count <= (uintptr_t)(arena->block->reserve_end - old_ptr) / size) {
+        arena_commit_grow__(arena, (count - old_count) * size);
+        room = (uintptr_t)(arena->end - old_ptr);
+    }
+    if (count > room / size) {
+        return false;
+    }
+
+    arena->start = old_ptr + count * size;
+    arena_unpoison_range__(old_end, arena->start);
+    memset(old_end, 0, (count - old_count) * size);
+#ifdef ARENA_STATS
+    arena_stats_record__(arena, site, (count - old_count) * size, 0);
+#endif /* ARENA_STATS */
+    return true;
 }
 
 [[nodiscard]]
-__attribute_malloc__
 __attribute_alloc_align__((4))
-void* arena_realloc__(Arena* restrict arena, uintptr_t count, uintptr_t size,
-                                                  uintptr_t alignment, void* old_ptr, uintptr_t old_count)
+void* arena_realloc__(Arena* restrict arena, uintptr_t count, uintptr_t size, uintptr_t alignment, void* old_ptr,
+                      uintptr_t old_count ARENA_SITE_PARAM__)
 {
     assert(arena);
     assert(count);
@@ -57,15 +624,27 @@ void* arena_realloc__(Arena* restrict arena, uintptr_t count, uintptr_t size,
     assert(old_ptr);
     assert(old_count);
 
-    uintptr_t padding = -(uintptr_t)arena->start & (alignment - 1);
-    uintptr_t available = (uintptr_t)arena->end - (uintptr_t)arena->start - padding;
-    assert(count < available / size);
-    if (available == 0 || count > available / size) {
-        arena_abort_fn__();
+    if (arena_resize_last__(arena, count, size, old_ptr, old_count ARENA_SITE_ARG__)) {
+        return old_ptr;
     }
-    void* val = arena->start + padding;
-    arena->start += padding + count * size;
+
+    void* val = arena_bump__(arena, count, size, alignment ARENA_SITE_ARG__);
     memset(val, 0, count * size);
     assert(old_ptr);
-    return memcpy(val, old_ptr, old_count * size);
+    return memcpy(val, old_ptr, (count < old_count ? count : old_count) * size);
+}
+
+bool arena_free_last__(Arena* restrict arena, void* ptr, uintptr_t bytes)
+{
+    assert(arena && ptr);
+    if ((char*)ptr + bytes != arena->start) {
+        return false;
+    }
+
+    arena->start = ptr;
+    arena_poison_range__((char*)ptr, (char*)ptr + bytes);
+#ifdef ARENA_STATS
+    arena_stats_update__(arena);
+#endif /* ARENA_STATS */
+    return true;
 }
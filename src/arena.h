@@ -4,13 +4,23 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/cdefs.h> // for __attribute_malloc__
 #include <time.h>
 
+// pages a reserved arena commits at a time, and keeps committed when it's reset
+#ifndef ARENA_COMMIT_SIZE
+#define ARENA_COMMIT_SIZE (1 << 16)
+#endif /* !ARENA_COMMIT_SIZE */
+
+typedef struct Arena_Block Arena_Block;
+
 typedef struct {
     char* start;
     char* end;
+    Arena_Block* block; // NULL for a fixed arena, which aborts when full
 } Arena;
 
 /* arena_abort_fn_set
@@ -18,6 +28,126 @@ typedef struct {
  */
 void arena_abort_fn_set(void (*abort_func)());
 
+/* arena_source_set
+ * Set the functions growable arenas get their blocks from and give them back to, malloc and free by default.
+ */
+void arena_source_set(void* (*allocate)(size_t), void (*release)(void*));
+
+/* arena_chain_new
+ * Create a growable arena starting with a block of size bytes. When the block is full another one, twice the size of
+ * the last, is chained on instead of aborting. Copies of the arena share its blocks, so a scratch arena passed by value
+ * reuses the blocks a callee chained once the callee returns.
+ * Returns: false if the first block couldn't be allocated.
+ */
+bool arena_chain_new(Arena* restrict arena, uintptr_t size);
+
+/* arena_reserve_new
+ * Create a growable arena which reserves size bytes of address space up front and commits pages from it as they're
+ * needed, ARENA_COMMIT_SIZE at a time. The arena never moves, so it grows without chaining or copying, and only the
+ * committed pages count towards RSS. It aborts once the whole reservation is used.
+ * Returns: false if the address space couldn't be reserved.
+ */
+bool arena_reserve_new(Arena* restrict arena, uintptr_t size);
+
+/* arena_ensure
+ * Make sure size bytes are available in the arena without it moving again, for splitting it into fixed arenas.
+ * Does nothing for fixed arenas.
+ */
+void arena_ensure(Arena* restrict arena, uintptr_t size);
+
+/* arena_trim
+ * Give back the memory past where the arena is up to, which only copies of it that are out of scope used.
+ * A chained arena releases the blocks after its current one, a reserved arena drops the pages with MADV_DONTNEED.
+ * Does nothing for fixed arenas.
+ */
+void arena_trim(Arena* restrict arena);
+
+/* arena_reset
+ * Rewind a growable arena to its start and trim it, keeping the first block or the first ARENA_COMMIT_SIZE bytes.
+ * Does nothing for fixed arenas.
+ */
+void arena_reset(Arena* restrict arena);
+
+/* arena_free
+ * Release every block of a chained arena or the whole reservation of a reserved arena.
+ */
+void arena_free(Arena* restrict arena);
+
+/* ARENA_STATS
+ * Building with ARENA_STATS records the count, bytes and alignment padding of the allocations made from each call site
+ * of arena_malloc and arena_realloc, and the high water mark of each arena named with arena_stats_name.
+ * The report is written to stderr on exit unless arena_stats_report already wrote it. Without ARENA_STATS the call
+ * sites aren't passed at all and arena_stats_name compiles to nothing.
+ */
+#ifdef ARENA_STATS
+typedef struct {
+    const char* file;
+    int line;
+} Arena_Site;
+
+#define ARENA_SITE__ , (Arena_Site){.file = __FILE__, .line = __LINE__}
+#define ARENA_SITE_PARAM__ , Arena_Site site
+
+/* arena_stats_name
+ * Track the high water mark of arena under name, along with every fixed arena split out of it.
+ */
+void arena_stats_name(Arena* restrict arena, const char* name);
+
+/* arena_stats_allocations
+ * The number of allocations made from every call site so far, for counting the allocations of a single call.
+ */
+uintptr_t arena_stats_allocations(void);
+
+void arena_stats_update__(Arena* restrict arena);
+#else
+#define ARENA_SITE__
+#define ARENA_SITE_PARAM__
+#define arena_stats_name(arena, name)
+#endif /* ARENA_STATS */
+
+/* arena_stats_report
+ * Write the high water mark and bytes in use of each named arena and the allocations of each call site to out.
+ * Built without ARENA_STATS it only says so.
+ */
+void arena_stats_report(FILE* restrict out);
+
+/* Arena_Mark
+ * Where an arena was up to, from arena_mark.
+ */
+typedef struct {
+    char* start;
+    char* end;
+    Arena_Block* block;
+} Arena_Mark;
+
+#ifdef ARENA_DEBUG
+void arena_poison__(Arena* restrict arena, Arena_Mark mark);
+#endif /* ARENA_DEBUG */
+
+/* arena_mark
+ * Checkpoint the arena, everything allocated after this is released by arena_restore.
+ */
+static inline Arena_Mark arena_mark(Arena* restrict arena)
+{
+    return (Arena_Mark){.start = arena->start, .end = arena->end, .block = arena->block};
+}
+
+/* arena_restore
+ * Release everything allocated in the arena since mark, so loops over candidates use scratch for one at a time.
+ * Blocks or pages used since mark are kept for the next allocations. With ARENA_DEBUG the released memory is poisoned,
+ * so ASan reports any use of a pointer which escaped the scope, or without ASan it reads back as garbage.
+ */
+static inline void arena_restore(Arena* restrict arena, Arena_Mark mark)
+{
+#ifdef ARENA_DEBUG
+    arena_poison__(arena, mark);
+#endif /* ARENA_DEBUG */
+    *arena = (Arena){.start = mark.start, .end = mark.end, .block = mark.block};
+#ifdef ARENA_STATS
+    arena_stats_update__(arena);
+#endif /* ARENA_STATS */
+}
+
 /* arena_new
  * Wrap in a function which returns a char*.
  * Free the char* which is returned when the arenas are no longer needed.
@@ -56,22 +186,32 @@ void arena_abort_fn_set(void (*abort_func)());
  * Call to allocate in the arena.
  * Convience wrapper for arena_malloc__
  */
-#define arena_malloc(arena, count, type) (type*)arena_malloc__(arena, count, sizeof(type), _Alignof(type))
+#define arena_malloc(arena, count, type)                                                                               \
+    (type*)arena_malloc__(arena, count, sizeof(type), _Alignof(type) ARENA_SITE__)
 
 void* arena_malloc__(Arena* restrict arena, uintptr_t count, uintptr_t size,
-                            uintptr_t alignment)
+                            uintptr_t alignment ARENA_SITE_PARAM__)
     __attribute_malloc__
     __attribute_alloc_align__((4));
 
 /* arena_realloc
  * Call to reallocate in the arena.
+ * The most recent allocation grows or shrinks in place when the arena has room, anything else is copied.
  * Convience wrapper for arena_realloc__
  */
 #define arena_realloc(arena, count, type, ptr, old_count)                                                              \
-    (type*)arena_realloc__(arena, count, sizeof(type), _Alignof(type), ptr, old_count);
+    (type*)arena_realloc__(arena, count, sizeof(type), _Alignof(type), ptr, old_count ARENA_SITE__);
 
 void* arena_realloc__(Arena* restrict arena, uintptr_t count, uintptr_t size, uintptr_t alignment, void* old_ptr,
-                             uintptr_t old_count)
-    __attribute_malloc__
+                             uintptr_t old_count ARENA_SITE_PARAM__)
     __attribute_alloc_align__((4));
 
+/* arena_free_last
+ * Give the memory of ptr back to the arena if it's the most recent allocation, otherwise it stays until the arena is
+ * restored or reset.
+ * Returns: true if the memory was given back.
+ */
+#define arena_free_last(arena, ptr, count, type) arena_free_last__(arena, ptr, (count) * sizeof(type))
+
+bool arena_free_last__(Arena* restrict arena, void* ptr, uintptr_t bytes);
+
@@ -134,12 +134,6 @@ void copy_into_i16(i16_slice_t* src, fzf_i16_t* dest)
 }
 
 // char* helpers
-bool has_prefix(const char* str, const char* prefix, size_t prefix_len)
-{
-    assert(str);
-    return !strncmp(prefix, str, prefix_len);
-}
-
 bool has_suffix(const char* str, size_t len, const char* suffix, size_t suffix_len)
 {
     assert(str && suffix);
@@ -148,68 +142,6 @@ bool has_suffix(const char* str, size_t len, const char* suffix, size_t suffix_l
     return len >= suffix_len && !strncmp(slice_str(str, len - suffix_len, len).data, suffix, suffix_len);
 }
 
-char* str_replace_char(char* str, char find, char replace)
-{
-    char* current_pos = strchr(str, find);
-    while (current_pos) {
-        *current_pos = replace;
-        current_pos = strchr(current_pos, find);
-    }
-    return str;
-}
-
-char* str_replace_slashes(char* orig, size_t orig_len, Arena* scratch_arena)
-{
-    if (!orig || !orig_len) {
-        return NULL;
-    }
-
-    constexpr char replace[] = "\\ ";
-    constexpr size_t replace_len = sizeof(replace) - 1;
-    constexpr char replacement[] = "\t";
-    constexpr size_t replacement_len = sizeof(replacement) - 1;
-
-    char* tmp;
-    char* result;
-    size_t count = 0;
-    char* ins = orig;
-
-    for (; (tmp = strstr(ins, replace)); ++count) {
-        ins = tmp + replace_len;
-    }
-
-    tmp = result = arena_malloc(scratch_arena, orig_len + (replacement_len - replace_len) * count + 1, char);
-    if (!result) {
-        return NULL;
-    }
-
-    size_t len_front = 0;
-    while (count--) {
-        ins = strstr(orig, replace);
-        assert(ins);
-        len_front = (size_t)(ins - orig);
-        tmp = strncpy(tmp, orig, len_front) + len_front;
-        tmp = strcpy(tmp, replacement) + replacement_len;
-        orig += len_front + replace_len;
-        orig_len -= len_front + replace_len;
-    }
-    strncpy(tmp, orig, orig_len);
-    tmp[orig_len] = 0;
-    return result;
-}
-
-// TODO(conni2461): REFACTOR
-char* str_tolower(char* str, size_t size, Arena* scratch_arena)
-{
-    assert(str);
-    char* lower_str = arena_malloc(scratch_arena, size + 1, char);
-    for (size_t i = 0; i < size; i++) {
-        lower_str[i] = (char)tolower((uint8_t)str[i]);
-    }
-    lower_str[size] = '\0';
-    return lower_str;
-}
-
 int16_t max16(int16_t a, int16_t b)
 {
     return (a > b) ? a : b;
@@ -396,6 +328,50 @@ int32_t ascii_fuzzy_index(fzf_string_t* input, const char* pattern, size_t size,
     return first_idx;
 }
 
+fzf_bitap_t* fzf_bitap_compile(bool case_sensitive, fzf_string_t* pattern, Arena* scratch_arena)
+{
+    assert(pattern);
+    const size_t M = pattern->size;
+    if (M == 0 || M > FZF_BITAP_MAX_PATTERN) {
+        return NULL;
+    }
+
+    fzf_bitap_t* bitap = arena_malloc(scratch_arena, 1, fzf_bitap_t);
+    for (size_t i = 0; i < M; i++) {
+        uint8_t c = (uint8_t)pattern->data[i];
+        uint64_t bit = (uint64_t)1 << i;
+        bitap->masks[c] |= bit;
+        // same folding as try_skip, lowercase pattern chars also match their uppercase
+        if (!case_sensitive && c >= 'a' && c <= 'z') {
+            bitap->masks[c - 32] |= bit;
+        }
+    }
+    bitap->accept = (uint64_t)1 << (M - 1);
+    return bitap;
+}
+
+int32_t fzf_bitap_index(const fzf_bitap_t* bitap, const fzf_string_t* text)
+{
+    assert(bitap && text);
+
+    // state bit k is set once pattern[0..k] has been seen as a subsequence
+    uint64_t state = 0;
+    size_t first = 0;
+    for (size_t i = 0; i < text->size; i++) {
+        uint64_t next = state | (((state << 1) | 1) & bitap->masks[(uint8_t)text->data[i]]);
+        if (!state && next) {
+            first = i;
+        }
+        state = next;
+        if (state & bitap->accept) {
+            assert(first <= INT32_MAX);
+            return first > 0 ? (int32_t)first - 1 : 0;
+        }
+    }
+
+    return -1;
+}
+
 int32_t calculate_score(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, size_t sidx, size_t eidx,
                         fzf_position_t* pos, Arena* scratch_arena)
 {
@@ -459,18 +435,15 @@ int32_t calculate_score(bool case_sensitive, fzf_string_t* text, fzf_string_t* p
     return score;
 }
 
-fzf_result_t fzf_fuzzy_match_v1(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, fzf_position_t* pos,
-                                fzf_slab_t* slab, Arena* scratch_arena)
+/* fuzzy_match_v1_unchecked
+ * fzf_fuzzy_match_v1 for a non-empty pattern already known to be a subsequence of text.
+ */
+fzf_result_t fuzzy_match_v1_unchecked(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern,
+                                      fzf_position_t* pos, Arena* scratch_arena)
 {
-    (void)slab;
     const size_t M = pattern->size;
     const size_t N = text->size;
-    if (M == 0) {
-        return (fzf_result_t){0, 0, 0};
-    }
-    if (ascii_fuzzy_index(text, pattern->data, M, case_sensitive) < 0) {
-        return (fzf_result_t){-1, -1, 0};
-    }
+    assert(M > 0);
 
     int32_t pidx = 0;
     int32_t sidx = -1;
@@ -520,26 +493,31 @@ fzf_result_t fzf_fuzzy_match_v1(bool case_sensitive, fzf_string_t* text, fzf_str
     return (fzf_result_t){-1, -1, 0};
 }
 
-fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, fzf_position_t* pos,
+fzf_result_t fzf_fuzzy_match_v1(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, fzf_position_t* pos,
                                 fzf_slab_t* slab, Arena* scratch_arena)
 {
+    (void)slab;
     const size_t M = pattern->size;
-    const size_t N = text->size;
     if (M == 0) {
         return (fzf_result_t){0, 0, 0};
     }
-    if (slab != NULL && N * M > slab->I16.cap) {
-        return fzf_fuzzy_match_v1(case_sensitive, text, pattern, pos, slab, scratch_arena);
+    if (ascii_fuzzy_index(text, pattern->data, M, case_sensitive) < 0) {
+        return (fzf_result_t){-1, -1, 0};
     }
 
-    size_t idx;
-    {
-        int32_t tmp_idx = ascii_fuzzy_index(text, pattern->data, M, case_sensitive);
-        if (tmp_idx < 0) {
-            return (fzf_result_t){-1, -1, 0};
-        }
-        idx = (size_t)tmp_idx;
-    }
+    return fuzzy_match_v1_unchecked(case_sensitive, text, pattern, pos, scratch_arena);
+}
+
+/* fuzzy_match_v2_from
+ * fzf_fuzzy_match_v2 for a non-empty pattern already known to be a subsequence of text starting the search at idx.
+ * The caller is responsible for falling back to v1 when the slab is too small.
+ */
+fzf_result_t fuzzy_match_v2_from(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, fzf_position_t* pos,
+                                 fzf_slab_t* slab, Arena* scratch_arena, size_t idx)
+{
+    const size_t M = pattern->size;
+    const size_t N = text->size;
+    assert(M > 0);
 
     size_t offset16 = 0;
     size_t offset32 = 0;
@@ -740,6 +718,26 @@ fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, fzf_string_t* text, fzf_str
     return (fzf_result_t){(int32_t)j, (int32_t)max_score_pos + 1, (int32_t)max_score};
 }
 
+fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, fzf_position_t* pos,
+                                fzf_slab_t* slab, Arena* scratch_arena)
+{
+    const size_t M = pattern->size;
+    const size_t N = text->size;
+    if (M == 0) {
+        return (fzf_result_t){0, 0, 0};
+    }
+    if (slab != NULL && N * M > slab->I16.cap) {
+        return fzf_fuzzy_match_v1(case_sensitive, text, pattern, pos, slab, scratch_arena);
+    }
+
+    int32_t idx = ascii_fuzzy_index(text, pattern->data, M, case_sensitive);
+    if (idx < 0) {
+        return (fzf_result_t){-1, -1, 0};
+    }
+
+    return fuzzy_match_v2_from(case_sensitive, text, pattern, pos, slab, scratch_arena, (size_t)idx);
+}
+
 fzf_result_t fzf_exact_match_naive(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, fzf_position_t* pos,
                                    fzf_slab_t* slab, Arena* scratch_arena)
 {
@@ -946,14 +944,113 @@ void append_pattern(fzf_pattern_t* pattern, fzf_term_set_t* value, Arena* scratc
     pattern->size++;
 }
 
+#define FZF_SCORE_BLOCK 64
+
+int32_t score_pattern(fzf_string_t* input, fzf_pattern_t* pattern, fzf_slab_t* slab, Arena* scratch_arena);
+
 #define CALL_ALG(term, input, pos, slab, scratch_arena)                                                                \
-    term->fn((term)->case_sensitive, &(input), (fzf_string_t*)(term)->text, pos, slab, scratch_arena)
+    call_term(term, &(input), pos, slab, scratch_arena)
+
+/* call_term_from
+ * Run the terms algorithm against input which already passed the terms prefilter with start index idx.
+ */
+fzf_result_t call_term_from(fzf_term_t* term, fzf_string_t* input, int32_t idx, fzf_position_t* pos, fzf_slab_t* slab,
+                            Arena* scratch_arena)
+{
+    assert(term->bitap && idx >= 0);
+    fzf_string_t* pattern = (fzf_string_t*)term->text;
+    if (term->fn == fzf_fuzzy_match_v2) {
+        if (slab != NULL && input->size * pattern->size > slab->I16.cap) {
+            return fuzzy_match_v1_unchecked(term->case_sensitive, input, pattern, pos, scratch_arena);
+        }
+        return fuzzy_match_v2_from(term->case_sensitive, input, pattern, pos, slab, scratch_arena, (size_t)idx);
+    }
+    if (term->fn == fzf_fuzzy_match_v1) {
+        return fuzzy_match_v1_unchecked(term->case_sensitive, input, pattern, pos, scratch_arena);
+    }
+
+    return term->fn(term->case_sensitive, input, pattern, pos, slab, scratch_arena);
+}
 
-// TODO(conni2461): REFACTOR
-/* assumption (maybe i change that later)
+/* call_term
+ * Run the terms algorithm against input, using the bit-parallel prefilter as a first stage when the term has one.
+ * Results are identical to calling term->fn directly, non-matching input just never reaches the algorithm.
+ */
+fzf_result_t call_term(fzf_term_t* term, fzf_string_t* input, fzf_position_t* pos, fzf_slab_t* slab,
+                       Arena* scratch_arena)
+{
+    if (!term->bitap) {
+        return term->fn(term->case_sensitive, input, (fzf_string_t*)term->text, pos, slab, scratch_arena);
+    }
+
+    int32_t idx = fzf_bitap_index(term->bitap, input);
+    if (idx < 0) {
+        return (fzf_result_t){-1, -1, 0};
+    }
+
+    return call_term_from(term, input, idx, pos, slab, scratch_arena);
+}
+
+/* fzf_token_next
+ * The next space separated token of pattern starting at *offset, escaped spaces ("\\ ") don't separate tokens.
+ * Returns: false when there are no tokens left.
+ */
+bool fzf_token_next(const char* pattern, size_t pat_len, size_t* offset, fzf_string_t* token, bool* needs_copy)
+{
+    size_t i = *offset;
+    while (i < pat_len && pattern[i] == ' ') {
+        ++i;
+    }
+    if (i == pat_len) {
+        *offset = i;
+        return false;
+    }
+
+    size_t start = i;
+    *needs_copy = false;
+    for (; i < pat_len; ++i) {
+        if (pattern[i] == '\t') {
+            *needs_copy = true;
+        }
+        else if (pattern[i] == ' ') {
+            if (i == start || pattern[i - 1] != '\\') {
+                break;
+            }
+            *needs_copy = true;
+        }
+    }
+
+    *token = (fzf_string_t){.data = pattern + start, .size = i - start};
+    *offset = i;
+    return true;
+}
+
+/* fzf_token_unescape
+ * Copy of a token with escaped spaces unescaped and tabs turned into spaces, for the few tokens which contain them.
+ */
+fzf_string_t fzf_token_unescape(fzf_string_t* token, Arena* scratch_arena)
+{
+    char* text = arena_malloc(scratch_arena, token->size + 1, char);
+    size_t len = 0;
+    for (size_t i = 0; i < token->size; ++i) {
+        char c = token->data[i];
+        if (c == '\\' && i + 1 < token->size && token->data[i + 1] == ' ') {
+            continue;
+        }
+        text[len++] = c == '\t' ? ' ' : c;
+    }
+
+    return (fzf_string_t){.data = text, .size = len};
+}
+
+/* fzf_parse_pattern
+ * Single pass over the pattern. Terms are slices of the caller's pattern, which isn't modified, so nothing is copied
+ * except tokens containing escaped spaces or tabs. There is no hidden state so patterns can be parsed concurrently,
+ * each with their own scratch arena.
+ * assumption (maybe i change that later)
  * - always v2 alg
  */
-fzf_pattern_t* fzf_parse_pattern(char* const pattern, size_t pat_len, Arena* scratch_arena)
+fzf_pattern_t* fzf_parse_pattern(const char* pattern, size_t pat_len, Arena* scratch_arena)
 {
     assert(scratch_arena);
 
@@ -965,57 +1062,48 @@ fzf_pattern_t* fzf_parse_pattern(char* const pattern, size_t pat_len, Arena* scr
     assert(pattern);
     assert(pattern[pat_len - 1] != '\0'); // not null terminated
 
-    char* pattern_copy = str_replace_slashes(pattern, pat_len, scratch_arena);
-    while (has_suffix(pattern, pat_len, " ", 1) && !has_suffix(pattern, pat_len, "\\ ", 2)) {
-        pattern[pat_len - 1] = 0;
-        pat_len--;
-    }
-
-    const char* delim = " ";
-    char* ptr = strtok(pattern_copy, delim);
-
     fzf_term_set_t* set = arena_malloc(scratch_arena, 1, fzf_term_set_t);
 
     bool switch_set = false;
     bool after_bar = false;
-    while (ptr != NULL) {
+    size_t offset = 0;
+    fzf_string_t token;
+    bool needs_copy;
+    while (fzf_token_next(pattern, pat_len, &offset, &token, &needs_copy)) {
         fzf_algo_t fn = fzf_fuzzy_match_v2;
         bool inv = false;
 
-        size_t len = strlen(ptr);
-        str_replace_char(ptr, '\t', ' ');
-        char* text = ptr;
-
-        char* og_str = text;
-        char* lower_text = str_tolower(text, len, scratch_arena);
-        bool case_sensitive = strcmp(text, lower_text) != 0;
+        if (needs_copy) {
+            token = fzf_token_unescape(&token, scratch_arena);
+        }
+        const char* text = token.data;
+        size_t len = token.size;
 
-        if (!case_sensitive) {
-            text = lower_text;
-            og_str = lower_text;
+        // lowercase patterns are matched case insensitively, so they are already in the form the matchers expect
+        bool case_sensitive = false;
+        for (size_t i = 0; i < len && !case_sensitive; ++i) {
+            case_sensitive = tolower((uint8_t)text[i]) != (uint8_t)text[i];
         }
 
-        if (set->size > 0 && !after_bar && !strcmp(text, "|")) {
+        if (set->size > 0 && !after_bar && len == 1 && *text == '|') {
             switch_set = false;
             after_bar = true;
-            ptr = strtok(NULL, delim);
             continue;
         }
         after_bar = false;
-        if (has_prefix(text, "!", 1)) {
+        if (len && *text == '!') {
             inv = true;
             fn = fzf_exact_match_naive;
             text++;
             len--;
         }
 
-        if (strcmp(text, "$") != 0 && has_suffix(text, len, "$", 1)) {
+        if (!(len == 1 && *text == '$') && has_suffix(text, len, "$", 1)) {
             fn = fzf_suffix_match;
-            text[len - 1] = 0;
             len--;
         }
 
-        if (has_prefix(text, "'", 1)) {
+        if (len && *text == '\'') {
             if (!inv) {
                 fn = fzf_exact_match_naive;
                 text++;
@@ -1027,7 +1115,7 @@ fzf_pattern_t* fzf_parse_pattern(char* const pattern, size_t pat_len, Arena* scr
                 len--;
             }
         }
-        else if (has_prefix(text, "^", 1)) {
+        else if (len && *text == '^') {
             if (fn == fzf_suffix_match) {
                 fn = fzf_equal_match;
             }
@@ -1048,16 +1136,20 @@ fzf_pattern_t* fzf_parse_pattern(char* const pattern, size_t pat_len, Arena* scr
             fzf_string_t* text_ptr = arena_malloc(scratch_arena, 1, fzf_string_t);
             text_ptr->data = text;
             text_ptr->size = len;
-            append_set(
-                set,
-                (fzf_term_t){.fn = fn, .inv = inv, .ptr = og_str, .text = text_ptr, .case_sensitive = case_sensitive},
-                scratch_arena);
+            // suffix match reports a match on text shorter than the pattern, so it can't be prefiltered
+            fzf_bitap_t* bitap =
+                fn != fzf_suffix_match ? fzf_bitap_compile(case_sensitive, text_ptr, scratch_arena) : NULL;
+            append_set(set,
+                       (fzf_term_t){.fn = fn,
+                                    .inv = inv,
+                                    .ptr = token.data,
+                                    .text = text_ptr,
+                                    .case_sensitive = case_sensitive,
+                                    .bitap = bitap},
+                       scratch_arena);
             switch_set = true;
         }
-
-        ptr = strtok(NULL, delim);
     }
-    assert(!ptr);
 
     if (set->size > 0) {
         append_pattern(pat_obj, set, scratch_arena);
@@ -1080,6 +1172,66 @@ fzf_pattern_t* fzf_parse_pattern(char* const pattern, size_t pat_len, Arena* scr
     return pat_obj;
 }
 
+bool fzf_prefilter(const char* text, size_t text_len, fzf_pattern_t* pattern)
+{
+    assert(pattern);
+    if (!pattern->ptr || pattern->only_inv) {
+        return true;
+    }
+
+    fzf_string_t input = {.data = text, .size = text_len};
+    for (size_t i = 0; i < pattern->size; i++) {
+        fzf_term_set_t* term_set = pattern->ptr[i];
+        bool possible = false;
+        for (size_t j = 0; j < term_set->size; j++) {
+            fzf_term_t* term = &term_set->ptr[j];
+            // inverse terms and terms without a prefilter can match anything
+            if (term->inv || !term->bitap || fzf_bitap_index(term->bitap, &input) >= 0) {
+                possible = true;
+                break;
+            }
+        }
+        if (!possible) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int32_t fzf_max_score(fzf_pattern_t* pattern)
+{
+    assert(pattern);
+    // empty and inverse only patterns score 0 or 1
+    if (!pattern->ptr || pattern->only_inv) {
+        return 1;
+    }
+
+    int32_t max_score = 0;
+    for (size_t i = 0; i < pattern->size; i++) {
+        fzf_term_set_t* term_set = pattern->ptr[i];
+        int32_t max_set_score = 0;
+        for (size_t j = 0; j < term_set->size; j++) {
+            fzf_term_t* term = &term_set->ptr[j];
+            if (term->inv) {
+                continue;
+            }
+
+            size_t M = ((fzf_string_t*)term->text)->size;
+            assert(M <= INT32_MAX / (ScoreMatch + BonusBoundary));
+            // no bonus exceeds BonusBoundary, and only the first character gets the multiplier
+            int32_t term_score =
+                (ScoreMatch + BonusBoundary) * (int32_t)M + (BonusFirstCharMultiplier - 1) * BonusBoundary;
+            if (term_score > max_set_score) {
+                max_set_score = term_score;
+            }
+        }
+        max_score += max_set_score;
+    }
+
+    return max_score;
+}
+
 int32_t fzf_get_score(const char* text, size_t text_len, fzf_pattern_t* pattern, fzf_slab_t* slab, Arena* scratch_arena)
 {
     // If the pattern is an empty string then pattern->ptr will be NULL and we
@@ -1088,14 +1240,86 @@ int32_t fzf_get_score(const char* text, size_t text_len, fzf_pattern_t* pattern,
         return 1;
     }
 
+    // single term patterns already get prefiltered by call_term
+    if (pattern->size > 1 && !fzf_prefilter(text, text_len, pattern)) {
+        return 0;
+    }
+
     fzf_string_t input = {.data = text, .size = text_len};
+    return score_pattern(&input, pattern, slab, scratch_arena);
+}
+
+void fzf_get_scores(const char** texts, const size_t* lens, size_t n, fzf_pattern_t* pattern, int32_t* out,
+                    fzf_slab_t* slab, Arena* scratch_arena)
+{
+    assert(texts && lens && pattern && out && scratch_arena);
+
+    if (!pattern->ptr) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = 1;
+        }
+        return;
+    }
+
+    // the usual z query is a single plain term, resolve it once instead of per candidate
+    fzf_term_t* single = NULL;
+    if (pattern->size == 1 && pattern->ptr[0]->size == 1 && !pattern->ptr[0]->ptr[0].inv) {
+        single = &pattern->ptr[0]->ptr[0];
+    }
+
+    size_t survivors[FZF_SCORE_BLOCK];
+    int32_t starts[FZF_SCORE_BLOCK];
+    for (size_t block = 0; block < n; block += FZF_SCORE_BLOCK) {
+        size_t block_end = min64u(block + FZF_SCORE_BLOCK, n);
+        size_t count = 0;
+
+        // Stage 1: run the prefilter over the whole block, only survivors reach the DP
+        for (size_t i = block; i < block_end; i++) {
+            out[i] = 0;
+            if (single && single->bitap) {
+                fzf_string_t input = {.data = texts[i], .size = lens[i]};
+                int32_t idx = fzf_bitap_index(single->bitap, &input);
+                if (idx >= 0) {
+                    starts[count] = idx;
+                    survivors[count++] = i;
+                }
+            }
+            else if (single || fzf_prefilter(texts[i], lens[i], pattern)) {
+                survivors[count++] = i;
+            }
+        }
+
+        // Stage 2: full scoring, per candidate scratch allocations are released before the next candidate
+        Arena_Mark mark = arena_mark(scratch_arena);
+        for (size_t k = 0; k < count; k++) {
+            size_t i = survivors[k];
+            fzf_string_t input = {.data = texts[i], .size = lens[i]};
+            if (!single) {
+                out[i] = score_pattern(&input, pattern, slab, scratch_arena);
+            }
+            else {
+                fzf_result_t res = single->bitap ? call_term_from(single, &input, starts[k], NULL, slab, scratch_arena)
+                                                 : CALL_ALG(single, input, NULL, slab, scratch_arena);
+                out[i] = res.start >= 0 ? res.score : 0;
+            }
+            arena_restore(scratch_arena, mark);
+        }
+    }
+}
+
+/* score_pattern
+ * fzf_get_score without the prefilter, for text which has already passed it.
+ */
+int32_t score_pattern(fzf_string_t* input, fzf_pattern_t* pattern, fzf_slab_t* slab, Arena* scratch_arena)
+{
+    assert(pattern->ptr);
     if (pattern->only_inv) {
         int final = 0;
         for (size_t i = 0; i < pattern->size; i++) {
             fzf_term_set_t* term_set = pattern->ptr[i];
             fzf_term_t* term = &term_set->ptr[0];
 
-            final += CALL_ALG(term, input, NULL, slab, scratch_arena).score;
+            final += CALL_ALG(term, *input, NULL, slab, scratch_arena).score;
         }
         return (final > 0) ? 0 : 1;
     }
@@ -1107,7 +1331,7 @@ int32_t fzf_get_score(const char* text, size_t text_len, fzf_pattern_t* pattern,
         bool matched = false;
         for (size_t j = 0; j < term_set->size; j++) {
             fzf_term_t* term = &term_set->ptr[j];
-            fzf_result_t res = CALL_ALG(term, input, NULL, slab, scratch_arena);
+            fzf_result_t res = CALL_ALG(term, *input, NULL, slab, scratch_arena);
             if (res.start >= 0) {
                 if (term->inv) {
                     continue;
@@ -59,12 +59,24 @@ typedef enum {
     CaseRespect
 } fzf_case_types;
 
+/* fzf_bitap_t
+ * Bit-parallel subsequence automaton for patterns of up to FZF_BITAP_MAX_PATTERN characters.
+ * Bit k of masks[c] is set when the k-th pattern character matches byte c.
+ */
+#define FZF_BITAP_MAX_PATTERN 64
+
+typedef struct {
+    uint64_t masks[256];
+    uint64_t accept;
+} fzf_bitap_t;
+
 typedef struct {
     fzf_algo_t fn;
     bool inv;
-    char* ptr;
+    const char* ptr; // the term as written, a slice of the pattern which isn't null terminated
     void* text;
     bool case_sensitive;
+    fzf_bitap_t* bitap;
 } fzf_term_t;
 
 typedef struct {
@@ -93,14 +105,27 @@ fzf_result_t fzf_suffix_match(bool case_sensitive, fzf_string_t* text, fzf_strin
 fzf_result_t fzf_equal_match(bool case_sensitive, fzf_string_t* text, fzf_string_t* pattern, fzf_position_t* pos,
                              fzf_slab_t* slab, Arena* scratch_arena);
 
+/* fzf_bitap_compile
+ * Compile the bit-parallel prefilter for a pattern, allocating using the scratch arena.
+ * Returns: the compiled prefilter, or NULL if the pattern is empty or longer than FZF_BITAP_MAX_PATTERN.
+ */
+fzf_bitap_t* fzf_bitap_compile(bool case_sensitive, fzf_string_t* pattern, Arena* scratch_arena);
+
+/* fzf_bitap_index
+ * Single pass subsequence test of the compiled pattern against text.
+ * Returns: -1 when the pattern is not a subsequence of text, otherwise the same start index ascii_fuzzy_index would.
+ */
+int32_t fzf_bitap_index(const fzf_bitap_t* bitap, const fzf_string_t* text);
+
 /* Public Interface */
 
 /* fzf_parse_pattern
  * Parse the fzf pattern, allocating using the scratch arena.
+ * pattern isn't modified and must outlive the parsed pattern, whose terms point into it. Reentrant.
  * pat_len should be equivalent to strlen, do not include null terminator in length.
  * Returns: a pointer to the pattern.
  */
-fzf_pattern_t* fzf_parse_pattern(char* const pattern, size_t pat_len, Arena* scratch_arena);
+fzf_pattern_t* fzf_parse_pattern(const char* pattern, size_t pat_len, Arena* scratch_arena);
 
 /* fzf_get_score
  * Get score for specific entry based on fzf_pattern_t.
@@ -111,6 +136,28 @@ fzf_pattern_t* fzf_parse_pattern(char* const pattern, size_t pat_len, Arena* scr
 int32_t fzf_get_score(const char* text, size_t text_len, fzf_pattern_t* pattern, fzf_slab_t* slab,
                       Arena* scratch_arena);
 
+/* fzf_get_scores
+ * Batch version of fzf_get_score, writes the fzf score for texts[i] with length lens[i] into out[i].
+ * Candidates are processed in blocks, prefiltered first and then fully scored, reusing the slab across candidates.
+ * Scratch allocations made while scoring a candidate are released before scoring the next one.
+ * lens should be equivalent to strlen, do not include null terminator in lengths.
+ */
+void fzf_get_scores(const char** texts, const size_t* lens, size_t n, fzf_pattern_t* pattern, int32_t* out,
+                    fzf_slab_t* slab, Arena* scratch_arena);
+
+/* fzf_max_score
+ * Upper bound on the score fzf_get_score can return for the pattern, every character matched consecutively on a
+ * word boundary.
+ */
+int32_t fzf_max_score(fzf_pattern_t* pattern);
+
+/* fzf_prefilter
+ * Cheap first stage run before fzf_get_score, only uses the bit-parallel prefilters compiled by fzf_parse_pattern.
+ * text_len should be equivalent to strlen, do not include null terminator in length.
+ * Returns: false when the text can't possibly score, true when it may.
+ */
+bool fzf_prefilter(const char* text, size_t text_len, fzf_pattern_t* pattern);
+
 fzf_slab_t* fzf_make_slab(fzf_slab_config_t config, Arena* scratch_arena);
 
 fzf_slab_t* fzf_make_default_slab(Arena* scratch_arena);
@@ -25,6 +25,19 @@
     "z rm {directory}:         Manually remove a directory from your z database. Can also call using 'z remove "       \
     "{directory}'.\n\n"
 #define HELP_Z_PRINT "z print:                  Print out information about the entries in your z database.\n\n"
+#define HELP_Z_INIT                                                                                                    \
+    "z init {bash|zsh|fish}:   Print a z function and cd hook for your shell, add 'eval \"$(z init bash)\"' to your "  \
+    "shell's rc file to use it.\n\n"
+#define HELP_Z_QUERY "z query {directory}:      Print the directory z would change to instead of changing to it.\n\n"
+#define HELP_Z_STATS                                                                                                   \
+    "z stats {directory}:      Print the arena high water marks and allocations by call site of resolving "            \
+    "{directory}, for builds with ARENA_STATS.\n\n"
+#define HELP_Z_DAEMON                                                                                                  \
+    "z daemon:                 Keep your z database in memory and answer other z commands over a socket, writing "     \
+    "changes to disk periodically.\n\n"
+#define HELP_Z_TRACE                                                                                                   \
+    "Z_TRACE=1 z {directory}:  Print how long each phase of the jump took. Set Z_TRACE to a file instead to append "   \
+    "the timings to it as Chrome trace events.\n\n"
 
 #define HELP_WRITE(str)                                                                                                \
     constexpr size_t str##_len = sizeof(str) - 1;                                                                      \
@@ -40,6 +53,11 @@ int z_help()
     HELP_WRITE(HELP_Z_ADD);
     HELP_WRITE(HELP_Z_RM);
     HELP_WRITE(HELP_Z_PRINT);
+    HELP_WRITE(HELP_Z_INIT);
+    HELP_WRITE(HELP_Z_QUERY);
+    HELP_WRITE(HELP_Z_DAEMON);
+    HELP_WRITE(HELP_Z_STATS);
+    HELP_WRITE(HELP_Z_TRACE);
     fflush(stdout);
     return EXIT_SUCCESS;
 }
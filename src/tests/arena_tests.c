@@ -85,6 +85,219 @@ void arena_realloc_non_char_test()
     ARENA_TEST_TEARDOWN;
 }
 
+void arena_realloc_in_place_test()
+{
+    ARENA_TEST_SETUP;
+
+    struct Test* values = arena_malloc(&arena, 4, struct Test);
+    values[3].test = 300;
+    struct Test* grown = arena_realloc(&arena, 8, struct Test, values, 4);
+    eassert(grown == values);
+    eassert(grown[3].test == 300 && !grown[7].test);
+    eassert(arena.start == (char*)(grown + 8));
+
+    struct Test* shrunk = arena_realloc(&arena, 2, struct Test, grown, 8);
+    eassert(shrunk == values);
+    eassert(arena.start == (char*)(shrunk + 2));
+
+    // anything allocated after it means it has to be copied
+    [[maybe_unused]] char* after = arena_malloc(&arena, 1, char);
+    struct Test* copied = arena_realloc(&arena, 4, struct Test, shrunk, 2);
+    eassert(copied != shrunk && !copied[3].test);
+
+    ARENA_TEST_TEARDOWN;
+}
+
+void arena_realloc_in_place_reserve_test()
+{
+    Arena arena = {0};
+    eassert(arena_reserve_new(&arena, 1 << 24));
+
+    // grows past the committed pages without moving
+    char* value = arena_malloc(&arena, 16, char);
+    char* grown = arena_realloc(&arena, ARENA_COMMIT_SIZE * 4, char, value, 16);
+    eassert(grown == value && !grown[ARENA_COMMIT_SIZE * 4 - 1]);
+
+    arena_free(&arena);
+}
+
+void arena_free_last_test()
+{
+    ARENA_TEST_SETUP;
+
+    char* first = arena_malloc(&arena, 16, char);
+    char* second = arena_malloc(&arena, 16, char);
+    eassert(!arena_free_last(&arena, first, 16, char));
+    eassert(arena_free_last(&arena, second, 16, char));
+    eassert(arena_free_last(&arena, first, 16, char));
+    eassert(arena_malloc(&arena, 16, char) == first);
+
+    ARENA_TEST_TEARDOWN;
+}
+
+void arena_chain_grows_test()
+{
+    Arena arena = {0};
+    eassert(arena_chain_new(&arena, 64));
+
+    struct Test* values[100];
+    for (size_t i = 0; i < 100; ++i) {
+        values[i] = arena_malloc(&arena, 10, struct Test);
+        values[i][9].test = i;
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        eassert(values[i][9].test == i);
+    }
+
+    char* large = arena_malloc(&arena, 1 << 16, char);
+    eassert(large && !large[(1 << 16) - 1]);
+
+    arena_free(&arena);
+    eassert(!arena.block);
+}
+
+static void arena_chain_callee(Arena scratch, char** value)
+{
+    *value = arena_malloc(&scratch, 128, char);
+}
+
+void arena_chain_reuse_test()
+{
+    Arena arena = {0};
+    eassert(arena_chain_new(&arena, 64));
+
+    // a copy of the arena chains a block, which the original moves on to once the copy has gone out of scope
+    char* callee_value;
+    arena_chain_callee(arena, &callee_value);
+    char* value = arena_malloc(&arena, 128, char);
+    eassert(value == callee_value);
+
+    arena_reset(&arena);
+    char* reset_value = arena_malloc(&arena, 8, char);
+    eassert(reset_value < value || reset_value > value + 128);
+
+    arena_free(&arena);
+}
+
+static size_t blocks_allocated;
+
+static void* arena_counting_allocate(size_t size)
+{
+    ++blocks_allocated;
+    return malloc(size);
+}
+
+static void arena_counting_release(void* block)
+{
+    --blocks_allocated;
+    free(block);
+}
+
+void arena_source_set_test()
+{
+    arena_source_set(arena_counting_allocate, arena_counting_release);
+    Arena arena = {0};
+    eassert(arena_chain_new(&arena, 64));
+    for (size_t i = 0; i < 10; ++i) {
+        [[maybe_unused]] char* value = arena_malloc(&arena, 64, char);
+    }
+    eassert(blocks_allocated > 1);
+
+    arena_reset(&arena);
+    eassert(blocks_allocated == 1);
+
+    arena_free(&arena);
+    eassert(!blocks_allocated);
+    arena_source_set(malloc, free);
+}
+
+void arena_reserve_grows_in_place_test()
+{
+    Arena arena = {0};
+    eassert(arena_reserve_new(&arena, 1 << 24));
+
+    char* first = arena_malloc(&arena, 1, char);
+    char* previous = first;
+    for (size_t i = 0; i < 8; ++i) {
+        char* value = arena_malloc(&arena, ARENA_COMMIT_SIZE / 2 + 1, char);
+        eassert(value > previous);
+        value[ARENA_COMMIT_SIZE / 2] = 'z';
+        previous = value;
+    }
+    eassert(previous - first < 5 * ARENA_COMMIT_SIZE);
+
+    // the pages past the first ARENA_COMMIT_SIZE bytes are dropped, they read back as zeroes
+    arena_reset(&arena);
+    eassert(!previous[ARENA_COMMIT_SIZE / 2]);
+    eassert(arena_malloc(&arena, 1, char) == first);
+
+    arena_ensure(&arena, 1 << 20);
+    eassert(arena.end - arena.start >= 1 << 20);
+
+    arena_free(&arena);
+    eassert(!arena.block);
+}
+
+static void arena_reserve_callee(Arena scratch, char** value)
+{
+    *value = arena_malloc(&scratch, ARENA_COMMIT_SIZE * 2, char);
+}
+
+void arena_reserve_trim_test()
+{
+    Arena arena = {0};
+    eassert(arena_reserve_new(&arena, 1 << 24));
+
+    // pages a copy committed are shared, trimming drops their contents without rewinding the arena
+    char* callee_value;
+    arena_reserve_callee(arena, &callee_value);
+    callee_value[ARENA_COMMIT_SIZE * 2 - 1] = 'z';
+    char* kept = arena_malloc(&arena, 8, char);
+    memcpy(kept, "kept", 5);
+
+    arena_trim(&arena);
+    eassert(!callee_value[ARENA_COMMIT_SIZE * 2 - 1]);
+    eassert(!strcmp(kept, "kept"));
+    eassert(arena_malloc(&arena, 1, char) > kept);
+
+    arena_free(&arena);
+}
+
+void arena_mark_restore_test()
+{
+    ARENA_TEST_SETUP;
+
+    char* kept = arena_malloc(&arena, 8, char);
+    Arena_Mark mark = arena_mark(&arena);
+    char* first = NULL;
+    for (size_t i = 0; i < 10; ++i) {
+        char* value = arena_malloc(&arena, 100, char);
+        eassert(!first || value == first);
+        first = value;
+        arena_restore(&arena, mark);
+    }
+    eassert(arena.start == mark.start && first > kept);
+
+    ARENA_TEST_TEARDOWN;
+}
+
+void arena_mark_restore_chain_test()
+{
+    Arena arena = {0};
+    eassert(arena_chain_new(&arena, 64));
+
+    Arena_Mark mark = arena_mark(&arena);
+    char* chained = arena_malloc(&arena, 256, char);
+    eassert(arena.block != mark.block);
+    arena_restore(&arena, mark);
+    eassert(arena.block == mark.block);
+
+    // the block chained inside the scope is reused rather than chaining another
+    eassert(arena_malloc(&arena, 256, char) == chained);
+
+    arena_free(&arena);
+}
+
 int main()
 {
     etest_start();
@@ -93,6 +306,16 @@ int main()
     etest_run(arena_malloc_multiple_test);
     etest_run(arena_realloc_test);
     etest_run(arena_realloc_non_char_test);
+    etest_run(arena_realloc_in_place_test);
+    etest_run(arena_realloc_in_place_reserve_test);
+    etest_run(arena_free_last_test);
+    etest_run(arena_chain_grows_test);
+    etest_run(arena_chain_reuse_test);
+    etest_run(arena_source_set_test);
+    etest_run(arena_reserve_grows_in_place_test);
+    etest_run(arena_reserve_trim_test);
+    etest_run(arena_mark_restore_test);
+    etest_run(arena_mark_restore_chain_test);
 
     etest_finish();
 
@@ -0,0 +1,322 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* fzf_bench: times the fzf scoring functions over generated paths, run with 'make bench' */
+/* This project is licensed under GNU GPLv3 */
+
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // for clock_gettime
+#endif                  /* ifndef _DEFAULT_SOURCE */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../arena.h"
+#include "../fzf.h"
+
+/* Output is one tab separated line per measurement: bench, corpus, metric and value, so runs from two builds can be
+ * diffed or joined on the first three columns. Built with ARENA_STATS only allocs_per_call is measured, the
+ * bookkeeping would skew the timings. 'make bench' runs both builds.
+ */
+
+#define BENCH_CANDIDATES 20000
+// each bench repeats passes over its corpus for at least this long and reports the fastest pass
+#define BENCH_MIN_NS (200 * 1000 * 1000)
+#define BENCH_MIN_PASSES 3
+// big enough that no single call chains another block, so scratch bytes can be measured from the arena position
+#define BENCH_SCRATCH_SIZE (1 << 24)
+#define BENCH_PATH_MAX 4096
+
+typedef struct {
+    const char* name;
+    size_t min_depth;
+    size_t max_depth;
+    size_t min_component; // random letters per component, 0 to use words
+    size_t max_component;
+    bool mixed_case;
+} Bench_Corpus_Config;
+
+static const Bench_Corpus_Config bench_corpus_configs[] = {
+    {.name = "shallow", .min_depth = 1, .max_depth = 3},
+    {.name = "deep", .min_depth = 8, .max_depth = 16},
+    {.name = "long", .min_depth = 3, .max_depth = 6, .min_component = 16, .max_component = 48},
+    {.name = "mixed_case", .min_depth = 3, .max_depth = 8, .mixed_case = true},
+};
+
+static const char* bench_words[] = {"src",    "home",   "projects", "lib",   "include", "tests", "build",
+                                    "docs",   "config", "cache",    "share", "local",   "bin",   "target",
+                                    "release", "debug", "assets",   "scripts", "vendor", "pkg",  "internal",
+                                    "cmd",    "web",    "api",      "tools", "notes",   "dotfiles", "z"};
+
+static const char* bench_roots[] = {"/home/user", "/home/user", "/home/user", "/usr", "/var/lib", "/opt"};
+
+// patterns in the forms z passes to fzf_parse_pattern, from plain keywords to several terms with operators
+static const char* bench_patterns[] = {"src",        "prsrc",     "^/home src", "tests$",       "'exact !cache",
+                                       "foo | bar",  "a b c d",   "Mixed",      "^/usr lib$",   "z\\ tests",
+                                       "!^/opt build", "dotfiles"};
+
+typedef struct {
+    const char* name;
+    char* buffer;
+    const char** texts;
+    size_t* lens;
+    size_t count;
+} Bench_Corpus;
+
+typedef struct Bench Bench;
+typedef int32_t (*Bench_Fn)(Bench* restrict bench, const char* text, size_t length, Arena* restrict scratch);
+
+struct Bench {
+    const char* name;
+    const char* pattern;
+    fzf_algo_t algo; // for the match functions
+    Bench_Fn fn;     // NULL for fzf_get_scores, which is called once per pass over the whole corpus
+    fzf_string_t pattern_string;
+    fzf_pattern_t* parsed;
+    fzf_slab_t* slab;
+};
+
+static volatile int64_t bench_sink; // keeps the results alive so the calls aren't optimized away
+
+/* bench_random
+ * xorshift64*, the corpora are the same for every run.
+ */
+static uint64_t bench_random(uint64_t* restrict state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t bench_range(uint64_t* restrict state, size_t min, size_t max)
+{
+    return min + (size_t)(bench_random(state) % (max - min + 1));
+}
+
+static bool bench_corpus_new(const Bench_Corpus_Config* restrict config, Bench_Corpus* restrict corpus)
+{
+    *corpus = (Bench_Corpus){.name = config->name, .count = BENCH_CANDIDATES};
+    corpus->buffer = malloc((size_t)BENCH_CANDIDATES * BENCH_PATH_MAX);
+    corpus->texts = malloc(BENCH_CANDIDATES * sizeof(char*));
+    corpus->lens = malloc(BENCH_CANDIDATES * sizeof(size_t));
+    if (!corpus->buffer || !corpus->texts || !corpus->lens) {
+        return false;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < BENCH_CANDIDATES; ++i) {
+        char* path = corpus->buffer + i * BENCH_PATH_MAX;
+        const char* root = bench_roots[bench_random(&state) % (sizeof(bench_roots) / sizeof(bench_roots[0]))];
+        size_t length = strlen(root);
+        memcpy(path, root, length);
+
+        size_t depth = bench_range(&state, config->min_depth, config->max_depth);
+        for (size_t d = 0; d < depth && length < BENCH_PATH_MAX - 64; ++d) {
+            path[length++] = '/';
+            size_t start = length;
+            if (config->min_component) {
+                size_t component = bench_range(&state, config->min_component, config->max_component);
+                for (size_t c = 0; c < component; ++c) {
+                    path[length++] = (char)('a' + bench_random(&state) % 26);
+                }
+            }
+            else {
+                const char* word = bench_words[bench_random(&state) % (sizeof(bench_words) / sizeof(bench_words[0]))];
+                size_t word_length = strlen(word);
+                memcpy(path + length, word, word_length);
+                length += word_length;
+                // most components are unique to their parent, like project names
+                if (bench_random(&state) % 2) {
+                    length += (size_t)snprintf(path + length, 8, "%u", (unsigned)(bench_random(&state) % 1000));
+                }
+            }
+
+            if (config->mixed_case) {
+                for (size_t c = start; c < length; ++c) {
+                    if ((c == start && bench_random(&state) % 2) || bench_random(&state) % 8 == 0) {
+                        path[c] = (char)(path[c] >= 'a' && path[c] <= 'z' ? path[c] - 'a' + 'A' : path[c]);
+                    }
+                }
+            }
+        }
+
+        path[length] = '\0';
+        corpus->texts[i] = path;
+        corpus->lens[i] = length;
+    }
+    return true;
+}
+
+static void bench_corpus_patterns(Bench_Corpus* restrict corpus, const char** texts, size_t* lens)
+{
+    constexpr size_t patterns_count = sizeof(bench_patterns) / sizeof(bench_patterns[0]);
+    for (size_t i = 0; i < patterns_count; ++i) {
+        texts[i] = bench_patterns[i];
+        lens[i] = strlen(bench_patterns[i]);
+    }
+    *corpus = (Bench_Corpus){.name = "patterns", .texts = texts, .lens = lens, .count = patterns_count};
+}
+
+static void bench_corpus_free(Bench_Corpus* restrict corpus)
+{
+    free(corpus->buffer);
+    free(corpus->texts);
+    free(corpus->lens);
+}
+
+static int32_t bench_get_score(Bench* restrict bench, const char* text, size_t length, Arena* restrict scratch)
+{
+    return fzf_get_score(text, length, bench->parsed, bench->slab, scratch);
+}
+
+static int32_t bench_algo(Bench* restrict bench, const char* text, size_t length, Arena* restrict scratch)
+{
+    fzf_string_t input = {.data = text, .size = length};
+    return bench->algo(false, &input, &bench->pattern_string, NULL, bench->slab, scratch).score;
+}
+
+static int32_t bench_parse_pattern(Bench* restrict bench, const char* text, size_t length, Arena* restrict scratch)
+{
+    (void)bench;
+    return (int32_t)fzf_parse_pattern(text, length, scratch)->size;
+}
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* bench_pass
+ * One pass over the corpus, scratch is released after every call like fzf_get_scores does.
+ * Returns: the scratch bytes the calls allocated.
+ */
+static uintptr_t bench_pass(Bench* restrict bench, Bench_Corpus* restrict corpus, int32_t* restrict scores,
+                            Arena* restrict scratch)
+{
+    uintptr_t bytes = 0;
+    if (!bench->fn) {
+        Arena_Mark mark = arena_mark(scratch);
+        fzf_get_scores(corpus->texts, corpus->lens, corpus->count, bench->parsed, scores, bench->slab, scratch);
+        bytes = (uintptr_t)(scratch->start - mark.start);
+        arena_restore(scratch, mark);
+        bench_sink += scores[0];
+        return bytes;
+    }
+
+    int64_t sink = 0;
+    for (size_t i = 0; i < corpus->count; ++i) {
+        Arena_Mark mark = arena_mark(scratch);
+        sink += bench->fn(bench, corpus->texts[i], corpus->lens[i], scratch);
+        bytes += (uintptr_t)(scratch->start - mark.start);
+        arena_restore(scratch, mark);
+    }
+    bench_sink += sink;
+    return bytes;
+}
+
+static void bench_run(Bench* restrict bench, Bench_Corpus* restrict corpus, int32_t* restrict scores,
+                      Arena* restrict scratch)
+{
+    size_t calls = bench->fn ? corpus->count : 1;
+
+#ifdef ARENA_STATS
+    uintptr_t allocations = arena_stats_allocations();
+    bench_pass(bench, corpus, scores, scratch);
+    allocations = arena_stats_allocations() - allocations;
+    printf("%s\t%s\tallocs_per_call\t%.3f\n", bench->name, corpus->name, (double)allocations / (double)calls);
+#else
+    // the first pass warms the caches and measures the scratch used
+    uintptr_t bytes = bench_pass(bench, corpus, scores, scratch);
+
+    uint64_t best = UINT64_MAX;
+    uint64_t total = 0;
+    for (size_t passes = 0; passes < BENCH_MIN_PASSES || total < BENCH_MIN_NS; ++passes) {
+        uint64_t start = bench_now();
+        bench_pass(bench, corpus, scores, scratch);
+        uint64_t elapsed = bench_now() - start;
+        total += elapsed;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    double ns_per_candidate = (double)best / (double)corpus->count;
+    printf("%s\t%s\tns_per_candidate\t%.2f\n", bench->name, corpus->name, ns_per_candidate);
+    printf("%s\t%s\tcandidates_per_sec\t%.0f\n", bench->name, corpus->name, 1e9 / ns_per_candidate);
+    printf("%s\t%s\tbytes_per_call\t%.2f\n", bench->name, corpus->name, (double)bytes / (double)calls);
+#endif /* ARENA_STATS */
+    fflush(stdout);
+}
+
+static Bench bench_scorers[] = {
+    {.name = "fzf_get_score", .pattern = "prsrc", .fn = bench_get_score},
+    {.name = "fzf_get_score_terms", .pattern = "^/home src !cache", .fn = bench_get_score},
+    {.name = "fzf_get_scores", .pattern = "prsrc"},
+    {.name = "fzf_fuzzy_match_v1", .pattern = "prsrc", .algo = fzf_fuzzy_match_v1, .fn = bench_algo},
+    {.name = "fzf_fuzzy_match_v2", .pattern = "prsrc", .algo = fzf_fuzzy_match_v2, .fn = bench_algo},
+    {.name = "fzf_exact_match_naive", .pattern = "src", .algo = fzf_exact_match_naive, .fn = bench_algo},
+    {.name = "fzf_prefix_match", .pattern = "/home/user/", .algo = fzf_prefix_match, .fn = bench_algo},
+    {.name = "fzf_suffix_match", .pattern = "src", .algo = fzf_suffix_match, .fn = bench_algo},
+    {.name = "fzf_equal_match", .pattern = "/home/user/src", .algo = fzf_equal_match, .fn = bench_algo},
+};
+
+int main(void)
+{
+    Arena scratch;
+    if (!arena_chain_new(&scratch, BENCH_SCRATCH_SIZE)) {
+        fputs("fzf_bench: couldn't allocate the scratch arena.\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    constexpr size_t corpora_count = sizeof(bench_corpus_configs) / sizeof(bench_corpus_configs[0]);
+    Bench_Corpus corpora[corpora_count];
+    int32_t* scores = malloc(BENCH_CANDIDATES * sizeof(int32_t));
+    bool ok = scores != NULL;
+    for (size_t i = 0; i < corpora_count; ++i) {
+        ok = bench_corpus_new(bench_corpus_configs + i, corpora + i) && ok;
+    }
+    if (!ok) {
+        fputs("fzf_bench: couldn't allocate the corpora.\n", stderr);
+        for (size_t i = 0; i < corpora_count; ++i) {
+            bench_corpus_free(corpora + i);
+        }
+        free(scores);
+        arena_free(&scratch);
+        return EXIT_FAILURE;
+    }
+
+    // what every call shares lives below the marks taken by bench_pass
+    fzf_slab_t* slab = fzf_make_default_slab(&scratch);
+    for (size_t i = 0; i < sizeof(bench_scorers) / sizeof(bench_scorers[0]); ++i) {
+        Bench* bench = bench_scorers + i;
+        bench->pattern_string = (fzf_string_t){.data = bench->pattern, .size = strlen(bench->pattern)};
+        bench->parsed = fzf_parse_pattern(bench->pattern, bench->pattern_string.size, &scratch);
+        bench->slab = slab;
+    }
+
+    printf("# bench\tcorpus\tmetric\tvalue\n");
+    printf("# %d candidates per corpus\n", BENCH_CANDIDATES);
+    for (size_t c = 0; c < corpora_count; ++c) {
+        for (size_t i = 0; i < sizeof(bench_scorers) / sizeof(bench_scorers[0]); ++i) {
+            bench_run(bench_scorers + i, corpora + c, scores, &scratch);
+        }
+    }
+
+    const char* pattern_texts[sizeof(bench_patterns) / sizeof(bench_patterns[0])];
+    size_t pattern_lens[sizeof(bench_patterns) / sizeof(bench_patterns[0])];
+    Bench_Corpus patterns;
+    bench_corpus_patterns(&patterns, pattern_texts, pattern_lens);
+    Bench parse = {.name = "fzf_parse_pattern", .fn = bench_parse_pattern};
+    bench_run(&parse, &patterns, scores, &scratch);
+
+    for (size_t i = 0; i < corpora_count; ++i) {
+        bench_corpus_free(corpora + i);
+    }
+    free(scores);
+    arena_free(&scratch);
+    return EXIT_SUCCESS;
+}
@@ -26,6 +26,7 @@ typedef enum {
 
 fzf_position_t* fzf_pos_array(size_t len, Arena* scratch_arena);
 fzf_position_t* fzf_get_positions(const char* text, fzf_pattern_t* pattern, fzf_slab_t* slab, Arena* scratch_arena);
+int32_t ascii_fuzzy_index(fzf_string_t* input, const char* pattern, size_t size, bool case_sensitive);
 
 #define call_alg(alg, case, txt, pat, assert_block)                                                                    \
     SCRATCH_ARENA_TEST_SETUP;                                                                                          \
@@ -467,6 +468,11 @@ TEST(EqualMatch, case3)
     });
 }
 
+// term text points into the pattern, so it isn't null terminated
+#define ASSERT_TERM_TEXT(expected, term)                                                                               \
+    ASSERT_EQ(sizeof(expected) - 1, ((fzf_string_t*)(term).text)->size);                                               \
+    ASSERT_EQ_MEM((void*)expected, (void*)((fzf_string_t*)(term).text)->data, sizeof(expected) - 1);
+
 TEST(PatternParsing, empty)
 {
     SCRATCH_ARENA_TEST_SETUP;
@@ -490,7 +496,7 @@ TEST(PatternParsing, simple)
     ASSERT_EQ(1, pat->ptr[0]->cap);
 
     ASSERT_EQ((void*)fzf_fuzzy_match_v2, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("lua", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("lua", pat->ptr[0]->ptr[0]);
     ASSERT_FALSE(pat->ptr[0]->ptr[0].case_sensitive);
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
@@ -507,7 +513,7 @@ TEST(PatternParsing, withEscapedSpace)
     ASSERT_EQ(1, pat->ptr[0]->cap);
 
     ASSERT_EQ((void*)fzf_fuzzy_match_v2, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("file ", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("file ", pat->ptr[0]->ptr[0]);
     ASSERT_FALSE(pat->ptr[0]->ptr[0].case_sensitive);
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
@@ -524,7 +530,7 @@ TEST(PatternParsing, withComplexEscapedSpace)
     ASSERT_EQ(1, pat->ptr[0]->cap);
 
     ASSERT_EQ((void*)fzf_fuzzy_match_v2, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("file with space", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("file with space", pat->ptr[0]->ptr[0]);
     ASSERT_FALSE(pat->ptr[0]->ptr[0].case_sensitive);
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
@@ -544,11 +550,11 @@ TEST(PatternParsing, withEscapedSpaceAndNormalSpace)
     ASSERT_EQ(1, pat->ptr[1]->cap);
 
     ASSERT_EQ((void*)fzf_fuzzy_match_v2, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("file ", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("file ", pat->ptr[0]->ptr[0]);
     ASSERT_FALSE(pat->ptr[0]->ptr[0].case_sensitive);
 
     ASSERT_EQ((void*)fzf_fuzzy_match_v2, pat->ptr[1]->ptr[0].fn);
-    ASSERT_EQ("new", ((fzf_string_t*)(pat->ptr[1]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("new", pat->ptr[1]->ptr[0]);
     ASSERT_FALSE(pat->ptr[1]->ptr[0].case_sensitive);
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
@@ -565,7 +571,7 @@ TEST(PatternParsing, invert)
     ASSERT_EQ(1, pat->ptr[0]->cap);
 
     ASSERT_EQ((void*)fzf_exact_match_naive, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("Lua", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("Lua", pat->ptr[0]->ptr[0]);
     ASSERT_TRUE(pat->ptr[0]->ptr[0].case_sensitive);
     ASSERT_TRUE(pat->ptr[0]->ptr[0].inv);
     SCRATCH_ARENA_TEST_TEARDOWN;
@@ -585,12 +591,12 @@ TEST(PatternParsing, invertMultiple)
     ASSERT_EQ(1, pat->ptr[1]->cap);
 
     ASSERT_EQ((void*)fzf_exact_match_naive, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("fzf", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("fzf", pat->ptr[0]->ptr[0]);
     ASSERT_FALSE(pat->ptr[0]->ptr[0].case_sensitive);
     ASSERT_TRUE(pat->ptr[0]->ptr[0].inv);
 
     ASSERT_EQ((void*)fzf_exact_match_naive, pat->ptr[1]->ptr[0].fn);
-    ASSERT_EQ("test", ((fzf_string_t*)(pat->ptr[1]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("test", pat->ptr[1]->ptr[0]);
     ASSERT_FALSE(pat->ptr[1]->ptr[0].case_sensitive);
     ASSERT_TRUE(pat->ptr[1]->ptr[0].inv);
     SCRATCH_ARENA_TEST_TEARDOWN;
@@ -608,7 +614,7 @@ TEST(PatternParsing, smartCase)
     ASSERT_EQ(1, pat->ptr[0]->cap);
 
     ASSERT_EQ((void*)fzf_fuzzy_match_v2, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("Lua", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("Lua", pat->ptr[0]->ptr[0]);
     ASSERT_TRUE(pat->ptr[0]->ptr[0].case_sensitive);
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
@@ -625,11 +631,11 @@ TEST(PatternParsing, simpleOr)
     ASSERT_EQ(2, pat->ptr[0]->cap);
 
     ASSERT_EQ((void*)fzf_exact_match_naive, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ("src", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("src", pat->ptr[0]->ptr[0]);
     ASSERT_FALSE(pat->ptr[0]->ptr[0].case_sensitive);
 
     ASSERT_EQ((void*)fzf_prefix_match, pat->ptr[0]->ptr[1].fn);
-    ASSERT_EQ("Lua", ((fzf_string_t*)(pat->ptr[0]->ptr[1].text))->data);
+    ASSERT_TERM_TEXT("Lua", pat->ptr[0]->ptr[1]);
     ASSERT_TRUE(pat->ptr[0]->ptr[1].case_sensitive);
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
@@ -653,25 +659,42 @@ TEST(PatternParsing, complexAnd)
     ASSERT_EQ(1, pat->ptr[3]->cap);
 
     ASSERT_EQ((void*)fzf_suffix_match, pat->ptr[0]->ptr[0].fn);
-    ASSERT_EQ(".lua", ((fzf_string_t*)(pat->ptr[0]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT(".lua", pat->ptr[0]->ptr[0]);
     ASSERT_FALSE(pat->ptr[0]->ptr[0].case_sensitive);
 
     ASSERT_EQ((void*)fzf_exact_match_naive, pat->ptr[1]->ptr[0].fn);
-    ASSERT_EQ("previewer", ((fzf_string_t*)(pat->ptr[1]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("previewer", pat->ptr[1]->ptr[0]);
     ASSERT_EQ(0, pat->ptr[1]->ptr[0].case_sensitive);
 
     ASSERT_EQ((void*)fzf_fuzzy_match_v2, pat->ptr[2]->ptr[0].fn);
-    ASSERT_EQ("term", ((fzf_string_t*)(pat->ptr[2]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("term", pat->ptr[2]->ptr[0]);
     ASSERT_FALSE(pat->ptr[2]->ptr[0].case_sensitive);
     ASSERT_TRUE(pat->ptr[2]->ptr[0].inv);
 
     ASSERT_EQ((void*)fzf_exact_match_naive, pat->ptr[3]->ptr[0].fn);
-    ASSERT_EQ("asdf", ((fzf_string_t*)(pat->ptr[3]->ptr[0].text))->data);
+    ASSERT_TERM_TEXT("asdf", pat->ptr[3]->ptr[0]);
     ASSERT_FALSE(pat->ptr[3]->ptr[0].case_sensitive);
     ASSERT_TRUE(pat->ptr[3]->ptr[0].inv);
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
 
+TEST(PatternParsing, patternUnmodified)
+{
+    SCRATCH_ARENA_TEST_SETUP;
+    const char str[] = "  src  Lua$  ";
+    fzf_pattern_t* pat = fzf_parse_pattern(str, sizeof(str) - 1, &scratch_arena);
+    ASSERT_EQ(2, pat->size);
+    ASSERT_EQ_MEM((void*)"  src  Lua$  ", (void*)str, sizeof(str));
+
+    ASSERT_TERM_TEXT("src", pat->ptr[0]->ptr[0]);
+    ASSERT_EQ((void*)(str + 2), (void*)pat->ptr[0]->ptr[0].ptr);
+    ASSERT_EQ((void*)fzf_suffix_match, pat->ptr[1]->ptr[0].fn);
+    ASSERT_TERM_TEXT("Lua", pat->ptr[1]->ptr[0]);
+    ASSERT_EQ((void*)(str + 7), (void*)((fzf_string_t*)pat->ptr[1]->ptr[0].text)->data);
+    ASSERT_TRUE(pat->ptr[1]->ptr[0].case_sensitive);
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
 static void score_wrapper(char* pattern, char** input, int* expected)
 {
 
@@ -727,6 +750,123 @@ TEST(ScoreIntegration, complexTerm)
     score_wrapper(".lua$ 'previewer !'term", input, expected);
 }
 
+static void bitap_wrapper(bool case_sensitive, char* pattern, char** input)
+{
+    SCRATCH_ARENA_TEST_SETUP;
+    fzf_string_t pat = {.data = pattern, .size = strlen(pattern)};
+    fzf_bitap_t* bitap = fzf_bitap_compile(case_sensitive, &pat, &scratch_arena);
+    ASSERT_TRUE(bitap != NULL);
+    for (size_t i = 0; input[i] != NULL; ++i) {
+        fzf_string_t text = {.data = input[i], .size = strlen(input[i])};
+        ASSERT_EQ(ascii_fuzzy_index(&text, pat.data, pat.size, case_sensitive), fzf_bitap_index(bitap, &text));
+    }
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+TEST(Bitap, matchesAsciiFuzzyIndex)
+{
+    char* input[] = {"src/fzf.c", "Src/FZF.h", "lua/fzf_lib.lua",    "README.md",
+                     "f",         "",          "zfs", "/home/user/src/fzf", NULL};
+    bitap_wrapper(false, "fzf", input);
+    bitap_wrapper(true, "fzf", input);
+    bitap_wrapper(false, "sfc", input);
+    bitap_wrapper(true, "FZF", input);
+    bitap_wrapper(false, "/", input);
+}
+
+TEST(Bitap, patternTooLong)
+{
+    SCRATCH_ARENA_TEST_SETUP;
+    char pattern[FZF_BITAP_MAX_PATTERN + 2] = {0};
+    memset(pattern, 'a', FZF_BITAP_MAX_PATTERN + 1);
+    fzf_string_t pat = {.data = pattern, .size = FZF_BITAP_MAX_PATTERN};
+    ASSERT_TRUE(fzf_bitap_compile(false, &pat, &scratch_arena) != NULL);
+    pat.size = FZF_BITAP_MAX_PATTERN + 1;
+    ASSERT_TRUE(fzf_bitap_compile(false, &pat, &scratch_arena) == NULL);
+    pat.size = 0;
+    ASSERT_TRUE(fzf_bitap_compile(false, &pat, &scratch_arena) == NULL);
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+// scores with the prefilter must be identical to calling the algorithms directly
+TEST(Bitap, scoresUnchanged)
+{
+    SCRATCH_ARENA_TEST_SETUP;
+    char* input[] = {"/home/user/src/fzf",       "/home/user/src/ncsh/src/z", "/usr/lib/node_modules",
+                     "/mnt/c/Users/Alex/source", "/home/user/Downloads",      "/tmp", NULL};
+    char* patterns[] = {"src", "Src", "nz", "'user", "^/home", "^/tmp$", "lib$", "dl | tmp", NULL};
+    fzf_slab_t* slab = fzf_make_slab((fzf_slab_config_t){(size_t)1 << 6, 1 << 6}, &scratch_arena);
+    for (size_t p = 0; patterns[p] != NULL; ++p) {
+        fzf_pattern_t* pat = fzf_parse_pattern(patterns[p], strlen(patterns[p]), &scratch_arena);
+        for (size_t i = 0; input[i] != NULL; ++i) {
+            fzf_string_t text = {.data = input[i], .size = strlen(input[i])};
+            int32_t expected = 0;
+            for (size_t j = 0; j < pat->size; ++j) {
+                int32_t set_score = -1;
+                for (size_t k = 0; k < pat->ptr[j]->size; ++k) {
+                    fzf_term_t* term = &pat->ptr[j]->ptr[k];
+                    fzf_result_t res = term->fn(term->case_sensitive, &text, term->text, NULL, slab, &scratch_arena);
+                    if (res.start >= 0) {
+                        set_score = res.score;
+                        break;
+                    }
+                }
+                if (set_score < 0) {
+                    expected = 0;
+                    break;
+                }
+                expected += set_score;
+            }
+            ASSERT_EQ(expected, fzf_get_score(input[i], text.size, pat, slab, &scratch_arena));
+            if (expected) {
+                ASSERT_TRUE(fzf_prefilter(input[i], text.size, pat));
+            }
+        }
+    }
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+// batch scores must be identical to scoring one candidate at a time
+TEST(ScoreIntegration, batch)
+{
+    SCRATCH_ARENA_TEST_SETUP;
+    const char* input[] = {"src/fzf.c",         "README.md", "lua/fzf_lib.lua", "Lua/fzf_lib.lua",
+                           "/home/user/src/z", "",          "test/test.c",     "previewers/term.lua"};
+    constexpr size_t n = sizeof(input) / sizeof(input[0]);
+    size_t lens[n];
+    for (size_t i = 0; i < n; ++i) {
+        lens[i] = strlen(input[i]);
+    }
+
+    char* patterns[] = {"fzf", "Lua", "!fzf", "'src | ^Lua", ".lua$ 'previewer !'term", "", NULL};
+    fzf_slab_t* slab = fzf_make_default_slab(&scratch_arena);
+    for (size_t p = 0; patterns[p] != NULL; ++p) {
+        fzf_pattern_t* pat = fzf_parse_pattern(patterns[p], strlen(patterns[p]), &scratch_arena);
+        int32_t out[n];
+        fzf_get_scores(input, lens, n, pat, out, slab, &scratch_arena);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(fzf_get_score(input[i], lens[i], pat, slab, &scratch_arena), out[i]);
+        }
+    }
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+TEST(ScoreIntegration, maxScoreIsUpperBound)
+{
+    SCRATCH_ARENA_TEST_SETUP;
+    const char* input[] = {"src/fzf.c", "fzf", "lua/fzf_lib.lua", "Lua", "/home/user/src/z", "fzf/Lua", NULL};
+    char* patterns[] = {"fzf", "Lua", "'fzf", "^fzf", "Lua$", "fzf | Lua", "fzf Lua", "!fzf", "", NULL};
+    fzf_slab_t* slab = fzf_make_default_slab(&scratch_arena);
+    for (size_t p = 0; patterns[p] != NULL; ++p) {
+        fzf_pattern_t* pat = fzf_parse_pattern(patterns[p], strlen(patterns[p]), &scratch_arena);
+        int32_t max_score = fzf_max_score(pat);
+        for (size_t i = 0; input[i] != NULL; ++i) {
+            ASSERT_TRUE(fzf_get_score(input[i], strlen(input[i]), pat, slab, &scratch_arena) <= max_score);
+        }
+    }
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
 static void pos_wrapper(char* pattern, char** input, int** expected)
 {
     SCRATCH_ARENA_TEST_SETUP;
@@ -0,0 +1,317 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* z_bench: loads, queries and writes generated databases of increasing size, run with 'make bench_z' */
+/* This project is licensed under GNU GPLv3 */
+
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // for clock_gettime and mkdtemp
+#endif                  /* ifndef _DEFAULT_SOURCE */
+
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../arena.h"
+#include "../z.h"
+
+/* Build with a Z_DATABASE_IN_MEMORY_LIMIT of at least the largest size, 'make bench_z' uses 1000000.
+ * Output is one tab separated line per measurement like fzf_bench: bench, entries, metric and value.
+ * Sizes can be passed as arguments, by default it runs 100 through 1000000 by powers of ten.
+ */
+
+// each size replays a workload of this many queries divided by its entries, clamped to the range below
+#define BENCH_QUERY_BUDGET 20000000
+#define BENCH_QUERIES_MIN 50
+#define BENCH_QUERIES_MAX 1000
+// the exponent of the Zipf distribution of ranks, access times and which entries are queried
+#define BENCH_ZIPF 1.0
+#define BENCH_HOME "/home/user"
+
+static const size_t bench_sizes[] = {100, 1000, 10000, 100000, 1000000};
+
+static const char* bench_words[] = {"src",    "projects", "lib",     "include", "tests",  "build",  "docs",
+                                    "config", "cache",    "share",   "local",   "target", "release", "debug",
+                                    "assets", "scripts",  "vendor",  "pkg",     "internal", "cmd",  "web",
+                                    "api",    "tools",    "notes",   "dotfiles", "work",  "personal", "go"};
+
+enum z_Result z_write(z_Database* restrict db);
+
+z_Directory* z_match_find(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                          z_Database* restrict db, Arena* restrict scratch_arena);
+
+/* bench_random
+ * xorshift64*, the databases and workloads are the same for every run.
+ */
+static uint64_t bench_random(uint64_t* restrict state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static const char* bench_word(uint64_t* restrict state)
+{
+    return bench_words[bench_random(state) % (sizeof(bench_words) / sizeof(bench_words[0]))];
+}
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* bench_rss_kb
+ * Current resident set size from /proc, -1 where there isn't one.
+ */
+static long bench_rss_kb(void)
+{
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return -1;
+    }
+    long size;
+    long resident;
+    bool read = fscanf(file, "%ld %ld", &size, &resident) == 2;
+    fclose(file);
+    return read ? resident * (sysconf(_SC_PAGESIZE) / 1024) : -1;
+}
+
+/* bench_zipf_new
+ * Cumulative probabilities of picking entry k, proportional to 1 / (k + 1)^BENCH_ZIPF.
+ */
+static double* bench_zipf_new(size_t count)
+{
+    double* cdf = malloc(count * sizeof(double));
+    if (!cdf) {
+        return NULL;
+    }
+    double total = 0;
+    for (size_t k = 0; k < count; ++k) {
+        total += 1.0 / pow((double)(k + 1), BENCH_ZIPF);
+        cdf[k] = total;
+    }
+    for (size_t k = 0; k < count; ++k) {
+        cdf[k] /= total;
+    }
+    return cdf;
+}
+
+static size_t bench_zipf(double* restrict cdf, size_t count, uint64_t* restrict state)
+{
+    double u = (double)(bench_random(state) >> 11) / (double)(1ULL << 53);
+    size_t low = 0;
+    size_t high = count - 1;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (cdf[middle] < u) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* bench_database_write
+ * Write a database of count entries under home. Paths are walks down a tree of common directory names ending in a
+ * numbered leaf so every path is unique. Entry k has the kth highest rank and was accessed roughly k minutes ago,
+ * both following a Zipf distribution like real visit histories.
+ */
+static enum z_Result bench_database_write(char* restrict database_file, size_t count)
+{
+    z_Database* db = calloc(1, sizeof(z_Database));
+    Arena arena;
+    if (!db || !arena_chain_new(&arena, 1 << 20)) {
+        free(db);
+        return Z_FAILURE;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ count;
+    time_t now = time(NULL);
+    char path[PATH_MAX];
+    for (size_t k = 0; k < count; ++k) {
+        int length = snprintf(path, sizeof(path), BENCH_HOME);
+        size_t depth = 1 + bench_random(&state) % 4 + bench_random(&state) % 4 + bench_random(&state) % 3;
+        for (size_t d = 0; d < depth; ++d) {
+            length += snprintf(path + length, sizeof(path) - (size_t)length, "/%s", bench_word(&state));
+        }
+        length += snprintf(path + length, sizeof(path) - (size_t)length, "/%s%zu", bench_word(&state), k);
+
+        z_Directory* dir = db->dirs + k;
+        dir->path_length = (size_t)length + 1;
+        dir->path = arena_malloc(&arena, dir->path_length, char);
+        memcpy(dir->path, path, dir->path_length);
+        double zipf = pow((double)(k + 1), BENCH_ZIPF);
+        dir->rank = fmax(1.0, 1000.0 / zipf);
+        dir->last_accessed = now - (time_t)(60.0 * zipf) - (time_t)(bench_random(&state) % 60);
+    }
+
+    db->count = count;
+    db->database_file = database_file;
+    enum z_Result result = z_write(db);
+    arena_free(&arena);
+    free(db);
+    return result;
+}
+
+/* bench_queries_new
+ * The workload for a database of count entries, targets of Zipf distributed entries. Half are the leaf name which
+ * z finds in the basename index, half are fuzzy abbreviations of the last two components which need a full search.
+ */
+static char** bench_queries_new(z_Database* restrict db, size_t queries, Arena* restrict arena)
+{
+    double* cdf = bench_zipf_new(db->count);
+    if (!cdf) {
+        return NULL;
+    }
+
+    uint64_t state = 0xD1B54A32D192ED03ULL ^ db->count;
+    char** targets = arena_malloc(arena, queries, char*);
+    for (size_t q = 0; q < queries; ++q) {
+        z_Directory* dir = db->dirs + bench_zipf(cdf, db->count, &state);
+        char* leaf = strrchr(dir->path, '/') + 1;
+        if (q % 2 == 0) {
+            size_t length = strlen(leaf) + 1;
+            targets[q] = arena_malloc(arena, length, char);
+            memcpy(targets[q], leaf, length);
+            continue;
+        }
+
+        char* parent = leaf - 2;
+        while (parent > dir->path && *parent != '/') {
+            --parent;
+        }
+        ++parent;
+        targets[q] = arena_malloc(arena, 8, char);
+        size_t parent_length = (size_t)(leaf - 1 - parent) < 3 ? (size_t)(leaf - 1 - parent) : 3;
+        size_t leaf_length = strlen(leaf) < 3 ? strlen(leaf) : 3;
+        memcpy(targets[q], parent, parent_length);
+        memcpy(targets[q] + parent_length, leaf, leaf_length);
+    }
+
+    free(cdf);
+    return targets;
+}
+
+static int bench_compare(const void* left, const void* right)
+{
+    uint64_t l = *(const uint64_t*)left;
+    uint64_t r = *(const uint64_t*)right;
+    return (l > r) - (l < r);
+}
+
+/* bench_run
+ * Load the database written for count entries, replay the query workload against it and write it back.
+ */
+static enum z_Result bench_run(Str* restrict location, size_t count, z_Database* restrict db, Arena* restrict arena,
+                               Arena* restrict scratch)
+{
+    uint64_t start = bench_now();
+    enum z_Result result = z_init(location, db, arena);
+    uint64_t load = bench_now() - start;
+    if (result != Z_SUCCESS || db->count != count) {
+        fprintf(stderr, "z_bench: loaded %zu of %zu entries.\n", db->count, count);
+        return Z_FAILURE;
+    }
+
+    size_t queries = BENCH_QUERY_BUDGET / count;
+    if (queries < BENCH_QUERIES_MIN) {
+        queries = BENCH_QUERIES_MIN;
+    }
+    if (queries > BENCH_QUERIES_MAX) {
+        queries = BENCH_QUERIES_MAX;
+    }
+    char** targets = bench_queries_new(db, queries, arena);
+    if (!targets) {
+        return Z_FAILURE;
+    }
+    uint64_t* latencies = arena_malloc(arena, queries, uint64_t);
+    size_t found = 0;
+    char cwd[] = BENCH_HOME;
+    for (size_t q = 0; q < queries; ++q) {
+        Arena_Mark mark = arena_mark(scratch);
+        start = bench_now();
+        found += z_match_find(targets[q], strlen(targets[q]) + 1, cwd, sizeof(cwd), db, scratch) != NULL;
+        latencies[q] = bench_now() - start;
+        arena_restore(scratch, mark);
+    }
+    qsort(latencies, queries, sizeof(uint64_t), bench_compare);
+    long rss = bench_rss_kb();
+
+    db->dirty = true;
+    start = bench_now();
+    result = z_write(db);
+    uint64_t write = bench_now() - start;
+
+    printf("z_init\t%zu\tms\t%.3f\n", count, (double)load / 1e6);
+    printf("z_match_find\t%zu\tp50_us\t%.1f\n", count, (double)latencies[queries / 2] / 1e3);
+    printf("z_match_find\t%zu\tp99_us\t%.1f\n", count, (double)latencies[queries * 99 / 100] / 1e3);
+    printf("z_match_find\t%zu\tfound\t%.3f\n", count, (double)found / (double)queries);
+    printf("z_write\t%zu\tms\t%.3f\n", count, (double)write / 1e6);
+    printf("rss\t%zu\tkb\t%ld\n", count, rss);
+    fflush(stdout);
+    return result;
+}
+
+static enum z_Result bench_size(Str* restrict location, size_t count)
+{
+    char database_file[PATH_MAX];
+    snprintf(database_file, sizeof(database_file), "%s" Z_DATABASE_FILE, location->value);
+    enum z_Result result = bench_database_write(database_file, count);
+    if (result != Z_SUCCESS) {
+        return result;
+    }
+
+    z_Database* db = calloc(1, sizeof(z_Database));
+    Arena arena = {0};
+    Arena scratch = {0};
+    if (db && arena_chain_new(&arena, 1 << 16) && arena_chain_new(&scratch, 1 << 16)) {
+        result = bench_run(location, count, db, &arena, &scratch);
+    }
+    else {
+        result = Z_FAILURE;
+    }
+
+    arena_free(&arena);
+    arena_free(&scratch);
+    free(db);
+    unlink(database_file);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    char directory[] = "/tmp/z_bench.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("z_bench: couldn't create a directory for the databases");
+        return EXIT_FAILURE;
+    }
+    char location_buffer[sizeof(directory) + 1];
+    snprintf(location_buffer, sizeof(location_buffer), "%s/", directory);
+    Str location = Str_New(location_buffer, sizeof(location_buffer));
+
+    printf("# bench\tentries\tmetric\tvalue\n");
+    int result = EXIT_SUCCESS;
+    size_t sizes_count = argc > 1 ? (size_t)argc - 1 : sizeof(bench_sizes) / sizeof(bench_sizes[0]);
+    for (size_t i = 0; i < sizes_count && result == EXIT_SUCCESS; ++i) {
+        size_t count = argc > 1 ? strtoul(argv[i + 1], NULL, 10) : bench_sizes[i];
+        if (!count || count > Z_DATABASE_IN_MEMORY_LIMIT) {
+            fprintf(stderr, "z_bench: sizes go from 1 to Z_DATABASE_IN_MEMORY_LIMIT (%d).\n",
+                    Z_DATABASE_IN_MEMORY_LIMIT);
+            result = EXIT_FAILURE;
+        }
+        else if (bench_size(&location, count) != Z_SUCCESS) {
+            result = EXIT_FAILURE;
+        }
+    }
+
+    rmdir(directory);
+    return result;
+}
@@ -1,12 +1,24 @@
 /* Copyright (c) z by Alex Eski 2024 */
 
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // for utimensat
+#endif                  /* ifndef _DEFAULT_SOURCE */
+
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "etest.h"
+#include "../fzf.h"
 #include "../z.h"
+#include "../z_context.h"
+#include "../z_daemon.h"
+#include "../z_platform.h"
 #include "lib/arena_test_helper.h"
 
 #define CWD_LENGTH 528
@@ -15,12 +27,51 @@ static Str config_location = {.length = 0, .value = NULL};
 
 double z_score(z_Directory* restrict directory, int fzf_score, time_t now);
 
+double z_frecency(z_Directory* restrict directory, time_t now);
+
+void z_frecencies(z_Directory* restrict dirs, size_t count, time_t now, double* restrict frecencies,
+                  Arena scratch_arena);
+
 z_Directory* z_match_find(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
                           z_Database* restrict db, Arena* restrict scratch_arena);
 
+z_Directory* z_match_find_parallel(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                                   z_Database* restrict db, Arena* restrict scratch_arena, size_t workers);
+
 enum z_Result z_database_add(char* restrict path, size_t path_length, char* restrict cwd, size_t cwd_length,
                              z_Database* restrict db, Arena* restrict arena);
 
+z_Directory* z_keywords_match_find(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                                   char* restrict cwd, size_t cwd_length, z_Database* restrict db,
+                                   Arena* restrict scratch_arena);
+
+z_Directory* z_basename_find(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                             z_Database* restrict db, time_t now);
+
+z_Match z_match_find_ranked(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                            z_Database* restrict db, Arena* restrict scratch_arena);
+
+uint64_t z_query_cache_key(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length);
+
+z_Directory* z_query_cache_find(uint64_t key, z_Database* restrict db, time_t now);
+
+void z_query_cache_store(uint64_t key, z_Match* restrict match, z_Database* restrict db, time_t now);
+
+void z_database_bump(z_Directory* dir, z_Database* db);
+
+enum z_Result z_write(z_Database* restrict db);
+
+enum z_Result z_directory_match_exists(char* restrict target, size_t target_length, char* restrict cwd, Str* restrict output,
+                                       z_Directory_Listing* restrict listing);
+
+enum z_Result z_read(z_Database* restrict db, Arena* restrict arena);
+
+enum z_Result z_read_level(z_Database* restrict db, Arena* restrict arena, enum z_Load level);
+
+enum z_Result z_write_entry_new(char* restrict path, size_t path_length, z_Database* restrict db, Arena* restrict arena);
+
+bool z_daemon_private(char* restrict path, bool create);
+
 // read from empty database file
 void z_read_empty_database_file_test()
 {
@@ -378,6 +429,680 @@ void z_match_find_multiple_matches_test()
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
 
+// frecency decays from 4x rank to 0.25x rank, the batch pass agrees with the single entry version
+void z_frecency_decay_test()
+{
+    SCRATCH_ARENA_TEST_SETUP;
+
+    time_t now = time(NULL);
+    z_Directory dirs[] = {
+        {.rank = 2.0, .last_accessed = now},
+        {.rank = 2.0, .last_accessed = now - Z_HOUR},
+        {.rank = 2.0, .last_accessed = now - Z_FRECENCY_HALF_LIFE},
+        {.rank = 2.0, .last_accessed = now - Z_WEEK},
+        {.rank = 2.0, .last_accessed = now - 100 * Z_MONTH},
+        {.rank = 2.0, .last_accessed = now + Z_HOUR},
+    };
+    constexpr size_t count = sizeof(dirs) / sizeof(dirs[0]);
+
+    double frecencies[count];
+    z_frecencies(dirs, count, now, frecencies, scratch_arena);
+    for (size_t i = 0; i < count; ++i) {
+        eassert(frecencies[i] == z_frecency(dirs + i, now));
+        eassert(frecencies[i] <= 8.0 && frecencies[i] >= 0.5);
+        if (i && i < count - 1) {
+            eassert(frecencies[i] <= frecencies[i - 1]);
+        }
+    }
+
+    eassert(frecencies[0] == 8.0);
+#ifndef Z_FRECENCY_BUCKETS
+    eassert(frecencies[1] == 8.0);
+    eassert(frecencies[2] > 4.3 && frecencies[2] < 4.5);
+    eassert(frecencies[4] < 0.501);
+#endif /* ifndef Z_FRECENCY_BUCKETS */
+    // accessed in the future from clock skew counts as just accessed
+    eassert(frecencies[5] == 8.0);
+
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+// parallel scoring picks the same entry as the serial scan, including ties
+void z_match_find_parallel_matches_serial_test()
+{
+    ARENA_TEST_SETUP;
+    SCRATCH_ARENA_TEST_SETUP;
+
+    z_Database db = {0};
+    time_t now = time(NULL);
+    for (size_t i = 0; i < Z_DATABASE_IN_MEMORY_LIMIT - 1; ++i) {
+        z_Directory* dir = db.dirs + i;
+        dir->path = arena_malloc(&arena, 64, char);
+        // every third entry shares the same path shape and rank so their scores tie
+        int len = snprintf(dir->path, 64, "/home/user/%s%zu/src", i % 3 ? "other" : "proj", i % 3 ? i : 1);
+        dir->path_length = (size_t)len + 1;
+        dir->rank = i % 3 ? (double)(i % 7) : 2.0;
+        dir->last_accessed = now - (time_t)(i % 5) * Z_DAY;
+        ++db.count;
+    }
+
+    char* cwd = "/home/user";
+    char* targets[] = {"proj", "src", "other12", "zzz", "user"};
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); ++t) {
+        Arena scratch = scratch_arena;
+        z_Directory* serial =
+            z_match_find_parallel(targets[t], strlen(targets[t]) + 1, cwd, strlen(cwd) + 1, &db, &scratch, 1);
+        for (size_t workers = 2; workers <= Z_PARALLEL_WORKERS; ++workers) {
+            scratch = scratch_arena;
+            z_Directory* parallel = z_match_find_parallel(targets[t], strlen(targets[t]) + 1, cwd, strlen(cwd) + 1, &db,
+                                                          &scratch, workers);
+            eassert(parallel == serial);
+        }
+    }
+
+    ARENA_TEST_TEARDOWN;
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+void z_match_find_pruned_matches_full_scan_test()
+{
+    ARENA_TEST_SETUP;
+    SCRATCH_ARENA_TEST_SETUP;
+
+    z_Database db = {0};
+    time_t now = time(NULL);
+    for (size_t i = 0; i < Z_DATABASE_IN_MEMORY_LIMIT - 1; ++i) {
+        z_Directory* dir = db.dirs + i;
+        dir->path = arena_malloc(&arena, 64, char);
+        int len = snprintf(dir->path, 64, "/home/user/%s%zu/src", i % 4 ? "other" : "proj", i % 11);
+        dir->path_length = (size_t)len + 1;
+        dir->rank = (double)(i % 13) + 1.0;
+        dir->last_accessed = now - (time_t)(i % 6) * Z_DAY;
+        ++db.count;
+    }
+
+    char* cwd = "/home/user";
+    char* targets[] = {"proj", "src", "other1", "zzz", "user", "proj3/src"};
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); ++t) {
+        Arena scratch = scratch_arena;
+        fzf_slab_t* slab = fzf_make_default_slab(&scratch);
+        fzf_pattern_t* pattern = fzf_parse_pattern(targets[t], strlen(targets[t]), &scratch);
+        z_Directory* expected = NULL;
+        double best = 0;
+        for (size_t i = 0; i < db.count; ++i) {
+            int fzf_score = fzf_get_score(db.dirs[i].path, db.dirs[i].path_length - 1, pattern, slab, &scratch);
+            if (!fzf_score)
+                continue;
+            double score = z_score(db.dirs + i, fzf_score, now);
+            if (!expected || score > best) {
+                best = score;
+                expected = db.dirs + i;
+            }
+        }
+
+        scratch = scratch_arena;
+        eassert(z_match_find_parallel(targets[t], strlen(targets[t]) + 1, cwd, strlen(cwd) + 1, &db, &scratch, 1) ==
+                expected);
+    }
+
+    ARENA_TEST_TEARDOWN;
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+// basename hits prefer exact over prefix, then highest frecency, ignoring case and the cwd
+void z_basename_find_test()
+{
+    ARENA_TEST_SETUP;
+
+    z_Database db = {0};
+    time_t now = time(NULL);
+    char* paths[] = {"/home/user/src/tests", "/home/user/old/tests/", "/home/user/testsuite", "/home/user/Tests",
+                     "/home/user/projects", "/"};
+    double ranks[] = {2.0, 1.0, 50.0, 3.0, 4.0, 1.0};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+        // added rather than pointing at the literals, removing an entry gives its path back to the pool
+        eassert(z_write_entry_new(paths[i], strlen(paths[i]) + 1, &db, &arena) == Z_SUCCESS);
+        db.dirs[i].rank = ranks[i];
+        db.dirs[i].last_accessed = now;
+    }
+
+    char* cwd = "/home/user";
+    eassert(z_basename_find("tests", 6, cwd, strlen(cwd) + 1, &db, now) == db.dirs + 3);
+    eassert(z_basename_find("test", 5, cwd, strlen(cwd) + 1, &db, now) == db.dirs + 2);
+    eassert(z_basename_find("PROJ", 5, cwd, strlen(cwd) + 1, &db, now) == db.dirs + 4);
+    eassert(!z_basename_find("user", 5, cwd, strlen(cwd) + 1, &db, now));
+    eassert(!z_basename_find("testsuites", 11, cwd, strlen(cwd) + 1, &db, now));
+    eassert(!z_basename_find("rojects", 8, cwd, strlen(cwd) + 1, &db, now));
+
+    // the cwd is never a match
+    char* tests_cwd = "/home/user/Tests";
+    eassert(z_basename_find("tests", 6, tests_cwd, strlen(tests_cwd) + 1, &db, now) == db.dirs);
+
+    // removing an entry shifts indexes, the index is rebuilt on the next lookup
+    eassert(z_remove("/home/user/src/tests", strlen("/home/user/src/tests") + 1, &db) == Z_SUCCESS);
+    eassert(z_basename_find("tests", 6, tests_cwd, strlen(tests_cwd) + 1, &db, now) == db.dirs);
+    eassert(!strcmp(db.dirs[0].path, "/home/user/old/tests/"));
+    eassert(z_basename_find("projects", 9, cwd, strlen(cwd) + 1, &db, now) == db.dirs + 3);
+
+    ARENA_TEST_TEARDOWN;
+}
+
+// earlier keywords match in order anywhere in the path, the last keyword only in the last component
+void z_keywords_match_find_test()
+{
+    ARENA_TEST_SETUP;
+    SCRATCH_ARENA_TEST_SETUP;
+
+    z_Database db = {0};
+    time_t now = time(NULL);
+    char* paths[] = {"/home/user/api/proj", "/home/user/proj/src/api", "/home/user/proj/web/api-docs",
+                     "/home/user/Proj/other", "/home/user/projapi"};
+    double ranks[] = {50.0, 2.0, 1.0, 10.0, 1.5};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+        db.dirs[i] = (z_Directory){.rank = ranks[i], .last_accessed = now, .path = paths[i],
+                                   .path_length = strlen(paths[i]) + 1};
+        ++db.count;
+    }
+
+    char* cwd = "/home/user";
+    size_t cwd_length = strlen(cwd) + 1;
+    char* proj_api[] = {"proj", "api"};
+    size_t proj_api_lengths[] = {5, 4};
+    Arena scratch = scratch_arena;
+    eassert(z_keywords_match_find(proj_api, proj_api_lengths, 2, cwd, cwd_length, &db, &scratch) == db.dirs + 1);
+
+    // keywords can share the last component as long as they stay in order
+    char* user_projapi[] = {"user", "proja", "pi"};
+    size_t user_projapi_lengths[] = {5, 6, 3};
+    scratch = scratch_arena;
+    eassert(z_keywords_match_find(user_projapi, user_projapi_lengths, 3, cwd, cwd_length, &db, &scratch) ==
+            db.dirs + 4);
+
+    // smart case
+    char* upper_proj[] = {"Proj", "oth"};
+    size_t upper_proj_lengths[] = {5, 4};
+    scratch = scratch_arena;
+    eassert(z_keywords_match_find(upper_proj, upper_proj_lengths, 2, cwd, cwd_length, &db, &scratch) == db.dirs + 3);
+
+    char* api_src[] = {"api", "src"};
+    size_t api_src_lengths[] = {4, 4};
+    scratch = scratch_arena;
+    eassert(!z_keywords_match_find(api_src, api_src_lengths, 2, cwd, cwd_length, &db, &scratch));
+
+    ARENA_TEST_TEARDOWN;
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+// cached answers survive the winner being bumped and a write/read, but not other entries changing
+void z_query_cache_test()
+{
+    ARENA_TEST_SETUP;
+    SCRATCH_ARENA_TEST_SETUP;
+
+    z_Database db = {.database_file = "_z_query_cache_test.bin"};
+    time_t now = time(NULL);
+    char* paths[] = {"/tmp", "/usr", "/home/user/tmp-old"};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+        db.dirs[i] = (z_Directory){.rank = 10.0 - (double)i, .last_accessed = now, .path = paths[i],
+                                   .path_length = strlen(paths[i]) + 1};
+        ++db.count;
+    }
+
+    char* cwd = "/home";
+    uint64_t key = z_query_cache_key("tmp", 4, cwd, strlen(cwd) + 1);
+    eassert(key == z_query_cache_key("  tmp ", 7, "/home/", 7));
+    eassert(key != z_query_cache_key("tmp", 4, "/home/user", 11));
+    eassert(key != z_query_cache_key("t mp", 5, cwd, strlen(cwd) + 1));
+    eassert(!z_query_cache_find(key, &db, now));
+
+    z_Match match = z_match_find_ranked("tmp", 4, cwd, strlen(cwd) + 1, &db, &scratch_arena);
+    eassert(match.dir == db.dirs);
+    eassert(match.z_score > match.runner_up);
+    z_query_cache_store(key, &match, &db, now);
+    eassert(z_query_cache_find(key, &db, now) == db.dirs);
+
+    z_database_bump(db.dirs, &db);
+    eassert(z_query_cache_find(key, &db, now) == db.dirs);
+
+    eassert(z_write(&db) == Z_SUCCESS);
+    z_Database read_db = {.database_file = db.database_file};
+    eassert(z_read(&read_db, &arena) == Z_SUCCESS);
+    eassert(read_db.count == db.count);
+    eassert(read_db.generation == db.generation);
+    eassert(z_query_cache_find(key, &read_db, now) == read_db.dirs);
+
+    z_database_bump(db.dirs + 1, &db);
+    eassert(!z_query_cache_find(key, &db, now));
+
+    // a stale entry which no longer exists isn't returned
+    match = z_match_find_ranked("tmp", 4, cwd, strlen(cwd) + 1, &db, &scratch_arena);
+    db.dirs[0].path = "/z_query_cache_test_missing";
+    db.dirs[0].path_length = strlen(db.dirs[0].path) + 1;
+    z_query_cache_store(key, &match, &db, now);
+    eassert(!z_query_cache_find(key, &db, now));
+
+    remove(db.database_file);
+    ARENA_TEST_TEARDOWN;
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+// direct children only, exact names first then a case insensitive match from the cached listing
+void z_directory_match_exists_test()
+{
+    char cwd[CWD_LENGTH];
+    eassert(getcwd(cwd, CWD_LENGTH));
+    size_t length = strlen(cwd);
+    memcpy(cwd + length, "/_z_probe_test", sizeof("/_z_probe_test"));
+
+    eassert(!mkdir(cwd, 0700));
+    char child[CWD_LENGTH + 32];
+    snprintf(child, sizeof(child), "%s/Sub", cwd);
+    eassert(!mkdir(child, 0700));
+    char file[CWD_LENGTH + 32];
+    snprintf(file, sizeof(file), "%s/file", cwd);
+    FILE* f = fopen(file, "w");
+    eassert(f);
+    fclose(f);
+
+    static z_Directory_Listing listing;
+    char buffer[NAME_MAX + 1];
+    Str output = {.value = buffer};
+    eassert(z_directory_match_exists("Sub", 4, cwd, &output, NULL) == Z_SUCCESS);
+    eassert(output.length == 4 && !strcmp(output.value, "Sub"));
+    eassert(z_directory_match_exists("sub", 4, cwd, &output, NULL) == Z_MATCH_NOT_FOUND);
+    eassert(z_directory_match_exists("file", 5, cwd, &output, &listing) == Z_MATCH_NOT_FOUND);
+    eassert(z_directory_match_exists("Sub/..", 7, cwd, &output, &listing) == Z_MATCH_NOT_FOUND);
+
+    output = (Str){.value = buffer};
+    eassert(z_directory_match_exists("SUB", 4, cwd, &output, &listing) == Z_SUCCESS);
+    eassert(listing.valid);
+    eassert(output.length == 4 && !strcmp(output.value, "Sub"));
+    output = (Str){.value = buffer};
+    eassert(z_directory_match_exists("sub", 4, cwd, &output, &listing) == Z_SUCCESS);
+    eassert(!strcmp(output.value, "Sub"));
+
+    // new subdirectories change the mtime so the listing is read again
+    char other[CWD_LENGTH + 32];
+    snprintf(other, sizeof(other), "%s/Other", cwd);
+    eassert(z_directory_match_exists("other", 6, cwd, &output, &listing) == Z_MATCH_NOT_FOUND);
+    eassert(!mkdir(other, 0700));
+    struct timespec times[2] = {{.tv_nsec = UTIME_NOW}, {.tv_sec = 1, .tv_nsec = 0}};
+    eassert(!utimensat(AT_FDCWD, cwd, times, 0));
+    eassert(z_directory_match_exists("other", 6, cwd, &output, &listing) == Z_SUCCESS);
+    eassert(!strcmp(output.value, "Other"));
+
+    rmdir(other);
+    rmdir(child);
+    remove(file);
+    rmdir(cwd);
+}
+
+// each load level reads only its part of the file, and clean databases aren't written back
+void z_read_level_test()
+{
+    ARENA_TEST_SETUP;
+
+    char* file = "_z_read_level_test.bin";
+    z_Database db = {.database_file = "_z_read_level_test_missing.bin"};
+    eassert(z_read_level(&db, &arena, Z_LOAD_NONE) == Z_SUCCESS);
+    eassert(access(db.database_file, F_OK) == -1);
+
+    db = (z_Database){.database_file = file};
+    time_t now = time(NULL);
+    char* paths[] = {"/home/user/a", "/home/user/b"};
+    for (size_t i = 0; i < 2; ++i) {
+        db.dirs[i] = (z_Directory){.rank = 1.0, .last_accessed = now, .path = paths[i], .path_length = 13};
+        ++db.count;
+    }
+    db.query_cache[0] = (z_Query_Cache_Slot){.key = 16, .entry = 1, .frecency = 4.0, .margin = 1.0};
+    eassert(z_write(&db) == Z_SUCCESS);
+
+    z_Database header = {.database_file = file};
+    eassert(z_read_level(&header, &arena, Z_LOAD_HEADER) == Z_SUCCESS);
+    eassert(header.count == 2 && !header.dirs[0].path);
+    eassert(z_exit(&header) == Z_SUCCESS);
+    header.dirty = true;
+    eassert(z_exit(&header) == Z_CANNOT_PROCESS);
+
+    z_Database entries = {.database_file = file};
+    eassert(z_read_level(&entries, &arena, Z_LOAD_ENTRIES) == Z_SUCCESS);
+    eassert(entries.count == 2 && !strcmp(entries.dirs[1].path, "/home/user/b"));
+    eassert(!entries.query_cache[0].entry);
+
+    z_Database full = {.database_file = file};
+    eassert(z_read_level(&full, &arena, Z_LOAD_FULL) == Z_SUCCESS);
+    eassert(full.count == 2 && full.query_cache[0].entry == 1);
+
+    remove(file);
+    eassert(z_exit(&full) == Z_SUCCESS);
+    eassert(access(file, F_OK) == -1);
+
+    ARENA_TEST_TEARDOWN;
+}
+
+// hooks append visits to the journal which the next load merges and the next write clears
+void z_journal_replay_test()
+{
+    ARENA_TEST_SETUP;
+
+    char* file = "_z_journal_test.bin";
+    eassert(z_journal_append(file, "/tmp", 5) == Z_SUCCESS);
+    eassert(z_journal_append(file, "/usr", 5) == Z_SUCCESS);
+    eassert(z_journal_append(file, "/tmp", 5) == Z_SUCCESS);
+    eassert(z_journal_append(file, "tmp", 0) == Z_BAD_STRING);
+    char long_path[Z_JOURNAL_RECORD_SIZE + 1];
+    memset(long_path, 'a', sizeof(long_path) - 1);
+    long_path[sizeof(long_path) - 1] = '\0';
+    eassert(z_journal_append(file, long_path, sizeof(long_path)) == Z_BAD_STRING);
+
+    z_Database db = {.database_file = file};
+    eassert(z_read_level(&db, &arena, Z_LOAD_ENTRIES) == Z_SUCCESS);
+    eassert(db.count == 2 && db.dirty && db.replayed);
+    eassert(!strcmp(db.dirs[0].path, "/tmp") && db.dirs[0].rank == 2);
+    eassert(!strcmp(db.dirs[1].path, "/usr") && db.dirs[1].rank == 1);
+    eassert(access("_z_journal_test.bin.journal", F_OK) == -1);
+
+    // another process loading meanwhile leaves the replay file to the one merging it
+    z_Database other_db = {.database_file = file};
+    eassert(z_read_level(&other_db, &arena, Z_LOAD_ENTRIES) == Z_SUCCESS);
+    eassert(other_db.count == 0 && !other_db.dirty && !other_db.replayed);
+
+    // visits recorded while the journal is being merged wait for the next load
+    eassert(z_journal_append(file, "/usr", 5) == Z_SUCCESS);
+    eassert(z_exit(&db) == Z_SUCCESS);
+    eassert(access("_z_journal_test.bin.journal.replay", F_OK) == -1);
+
+    z_Database read_db = {.database_file = file};
+    eassert(z_read_level(&read_db, &arena, Z_LOAD_ENTRIES) == Z_SUCCESS);
+    eassert(read_db.count == 2 && read_db.replayed);
+    eassert(read_db.dirs[0].rank == 2 && read_db.dirs[1].rank == 2);
+    eassert(z_exit(&read_db) == Z_SUCCESS);
+
+    remove(file);
+    ARENA_TEST_TEARDOWN;
+}
+
+// a writer which opened the journal before it was moved aside and appends after it was read still gets its visit in,
+// and an older visit doesn't move an entry's access time back
+void z_journal_replay_late_append_test()
+{
+    ARENA_TEST_SETUP;
+
+    char* file = "_z_journal_late_test.bin";
+    eassert(z_journal_append(file, "/tmp", 5) == Z_SUCCESS);
+    int writer_fd = open("_z_journal_late_test.bin.journal", O_WRONLY | O_APPEND | O_CLOEXEC);
+    eassert(writer_fd != -1);
+
+    z_Database db = {.database_file = file};
+    eassert(z_read_level(&db, &arena, Z_LOAD_ENTRIES) == Z_SUCCESS);
+    eassert(db.count == 1 && db.replayed);
+    time_t last_accessed = db.dirs[0].last_accessed;
+
+    z_Journal_Record record = {.visited = 1, .path_length = 5};
+    memcpy(record.path, "/tmp", 5);
+    eassert(write(writer_fd, &record, sizeof(record)) == sizeof(record));
+    close(writer_fd);
+    eassert(z_exit(&db) == Z_SUCCESS);
+    eassert(access("_z_journal_late_test.bin.journal.replay", F_OK) == -1);
+
+    z_Database read_db = {.database_file = file};
+    eassert(z_read_level(&read_db, &arena, Z_LOAD_ENTRIES) == Z_SUCCESS);
+    eassert(read_db.count == 1 && read_db.replayed && read_db.dirs[0].rank == 2);
+    eassert(read_db.dirs[0].last_accessed == last_accessed);
+    eassert(z_exit(&read_db) == Z_SUCCESS);
+
+    remove(file);
+    ARENA_TEST_TEARDOWN;
+}
+
+void z_read_full_database_test()
+{
+    ARENA_TEST_SETUP;
+
+    z_Database db = {.database_file = "_z_full_test.bin"};
+    char path[32];
+    for (size_t i = 0; i < Z_DATABASE_IN_MEMORY_LIMIT; ++i) {
+        int length = snprintf(path, sizeof(path), "/tmp/%zu", i);
+        eassert(z_write_entry_new(path, (size_t)length + 1, &db, &arena) == Z_SUCCESS);
+    }
+    eassert(z_write_entry_new("/tmp", sizeof("/tmp"), &db, &arena) == Z_FAILURE);
+    eassert(z_exit(&db) == Z_SUCCESS);
+
+    z_Database read_db = {.database_file = "_z_full_test.bin"};
+    eassert(z_read_level(&read_db, &arena, Z_LOAD_FULL) == Z_SUCCESS);
+    eassert(read_db.count == Z_DATABASE_IN_MEMORY_LIMIT);
+    for (size_t i = 0; i < read_db.count; ++i) {
+        snprintf(path, sizeof(path), "/tmp/%zu", i);
+        eassert(read_db.dirs[i].path && !strcmp(read_db.dirs[i].path, path));
+    }
+
+    remove("_z_full_test.bin");
+    ARENA_TEST_TEARDOWN;
+}
+
+// removed paths are reused by the next paths added in their size class instead of taking more of the arena
+void z_database_remove_reuses_path_test()
+{
+    ARENA_TEST_SETUP;
+
+    z_Database db = {0};
+    eassert(z_write_entry_new("/home/user/projects", sizeof("/home/user/projects"), &db, &arena) == Z_SUCCESS);
+    eassert(z_write_entry_new("/tmp", sizeof("/tmp"), &db, &arena) == Z_SUCCESS);
+    char* removed = db.dirs[0].path;
+    char* start = arena.start;
+
+    for (size_t i = 0; i < 1000; ++i) {
+        eassert(z_database_remove("/home/user/projects", sizeof("/home/user/projects"), &db) == Z_SUCCESS);
+        eassert(z_write_entry_new("/home/user/projects", sizeof("/home/user/projects"), &db, &arena) == Z_SUCCESS);
+    }
+    eassert(arena.start == start);
+    eassert(db.count == 2 && db.dirs[1].path == removed);
+    eassert(!strcmp(db.dirs[1].path, "/home/user/projects") && !strcmp(db.dirs[0].path, "/tmp"));
+
+    // a shorter path in the same class takes the block, a longer one in the next class doesn't
+    eassert(z_database_remove("/home/user/projects", sizeof("/home/user/projects"), &db) == Z_SUCCESS);
+    eassert(z_write_entry_new("/home/user/src/z", sizeof("/home/user/src/z"), &db, &arena) == Z_SUCCESS);
+    eassert(db.dirs[1].path == removed && arena.start == start);
+    eassert(z_database_remove("/home/user/src/z", sizeof("/home/user/src/z"), &db) == Z_SUCCESS);
+    eassert(z_write_entry_new("/home/user/projects/a/b/c", sizeof("/home/user/projects/a/b/c"), &db, &arena) ==
+            Z_SUCCESS);
+    eassert(db.dirs[1].path != removed && arena.start > start);
+
+    ARENA_TEST_TEARDOWN;
+}
+
+// prints rather than changes to the matched directory, falling back to a subdirectory of cwd like z
+void z_resolve_test()
+{
+    ARENA_TEST_SETUP;
+    SCRATCH_ARENA_TEST_SETUP;
+
+    z_Database db = {.database_file = "_z_resolve_test.bin"};
+    char* path = "/tmp";
+    db.dirs[0] = (z_Directory){.rank = 1, .last_accessed = time(NULL), .path = path, .path_length = strlen(path) + 1};
+    db.count = 1;
+
+    char buffer[PATH_MAX];
+    Str output = Str_New(buffer, sizeof(buffer));
+    char* target = "tmp";
+    size_t target_length = strlen(target) + 1;
+    eassert(z_resolve(&target, &target_length, 1, "/", &db, &arena, scratch_arena, &output) == Z_SUCCESS);
+    eassert(output.length == 5 && !memcmp(output.value, "/tmp", 5));
+    eassert(db.dirs[0].rank == 2);
+
+    char cwd[CWD_LENGTH];
+    eassert(getcwd(cwd, CWD_LENGTH));
+    eassert(!mkdir("_z_resolve_test", 0700));
+    target = "_z_resolve_test";
+    target_length = strlen(target) + 1;
+    output.length = sizeof(buffer);
+    eassert(z_resolve(&target, &target_length, 1, cwd, &db, &arena, scratch_arena, &output) == Z_SUCCESS);
+    eassert(db.count == 2);
+    eassert(estrcmp(output.value, output.length, db.dirs[1].path, db.dirs[1].path_length));
+
+    target = "_z_resolve_test_missing";
+    target_length = strlen(target) + 1;
+    output.length = sizeof(buffer);
+    eassert(z_resolve(&target, &target_length, 1, cwd, &db, &arena, scratch_arena, &output) == Z_MATCH_NOT_FOUND);
+    eassert(db.count == 2);
+
+    rmdir("_z_resolve_test");
+    ARENA_TEST_TEARDOWN;
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+typedef struct {
+    int fd;
+    z_Database* db;
+    Arena* arena;
+    Arena scratch_arena;
+    enum z_Result result;
+} z_Daemon_Test_Server;
+
+void* z_daemon_test_serve(void* arg)
+{
+    z_Daemon_Test_Server* server = arg;
+    server->result = z_daemon_serve(server->fd, server->db, server->arena, server->scratch_arena);
+    return NULL;
+}
+
+// queries, adds and removes over a socket pair against a database held by the serving side
+void z_daemon_serve_test()
+{
+    ARENA_TEST_SETUP;
+    SCRATCH_ARENA_TEST_SETUP;
+
+    z_Database db = {.database_file = "_z_daemon_test.bin"};
+    int fds[2];
+    eassert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    z_Daemon_Test_Server server = {.fd = fds[1], .db = &db, .arena = &arena, .scratch_arena = scratch_arena};
+    pthread_t thread;
+    eassert(!pthread_create(&thread, NULL, z_daemon_test_serve, &server));
+
+    char buffer[PATH_MAX];
+    Str output = Str_New(buffer, sizeof(buffer));
+    eassert(z_daemon_request(fds[0], Z_DAEMON_QUERY, "tmp", 4, "/home", 6, &output) == Z_MATCH_NOT_FOUND);
+    eassert(!output.length);
+
+    eassert(z_daemon_request(fds[0], Z_DAEMON_ADD, "/tmp", 5, NULL, 0, NULL) == Z_SUCCESS);
+    eassert(z_daemon_request(fds[0], Z_DAEMON_ADD, "/tmp", 5, NULL, 0, NULL) == Z_SUCCESS);
+    output.length = sizeof(buffer);
+    eassert(z_daemon_request(fds[0], Z_DAEMON_QUERY, "tmp", 4, "/home", 6, &output) == Z_SUCCESS);
+    eassert(output.length == 5 && !memcmp(output.value, "/tmp", 5));
+
+    // keywords are sent one after another, each with its own null terminator
+    eassert(z_daemon_request(fds[0], Z_DAEMON_ADD, "/usr/lib", 9, NULL, 0, NULL) == Z_SUCCESS);
+    output.length = sizeof(buffer);
+    eassert(z_daemon_request(fds[0], Z_DAEMON_QUERY, "usr\0lib", 8, "/home", 6, &output) == Z_SUCCESS);
+    eassert(output.length == 9 && !memcmp(output.value, "/usr/lib", 9));
+    output.length = sizeof(buffer);
+    eassert(z_daemon_request(fds[0], Z_DAEMON_QUERY, "usr\0\0", 5, "/home", 6, &output) == Z_MATCH_NOT_FOUND);
+    eassert(z_daemon_request(fds[0], Z_DAEMON_REMOVE, "/usr/lib", 9, NULL, 0, NULL) == Z_SUCCESS);
+
+    eassert(z_daemon_request(fds[0], Z_DAEMON_REMOVE, "/tmp", 5, NULL, 0, NULL) == Z_SUCCESS);
+    eassert(z_daemon_request(fds[0], Z_DAEMON_REMOVE, "/tmp", 5, NULL, 0, NULL) == Z_MATCH_NOT_FOUND);
+    output.length = sizeof(buffer);
+    eassert(z_daemon_request(fds[0], Z_DAEMON_QUERY, "tmp", 4, "/home", 6, &output) == Z_MATCH_NOT_FOUND);
+
+    close(fds[0]);
+    eassert(!pthread_join(thread, NULL));
+    close(fds[1]);
+    eassert(server.result == Z_SUCCESS);
+    // nothing is written until the daemon flushes
+    eassert(db.dirty && db.count == 0);
+    eassert(access(db.database_file, F_OK) == -1);
+
+    ARENA_TEST_TEARDOWN;
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
+// sockets are only trusted in a directory the current user owns and nobody else can get into
+void z_daemon_private_test()
+{
+    char* path = "_z_daemon_private_test/" Z_DAEMON_SOCKET;
+    rmdir("_z_daemon_private_test");
+    eassert(!z_daemon_private(path, false));
+    eassert(z_daemon_private(path, true));
+    eassert(z_daemon_private(path, false));
+
+    eassert(!chmod("_z_daemon_private_test", 0755));
+    eassert(!z_daemon_private(path, true));
+    eassert(!z_daemon_private(Z_DAEMON_SOCKET, true));
+
+    rmdir("_z_daemon_private_test");
+}
+
+/* z_match_in_child
+ * Score target with scratch_size bytes of scratch in a child process, on workers threads or as z_match_find picks when
+ * workers is 0. True if it found expected, false if it found anything else or ran out of memory.
+ */
+static bool z_match_in_child(char* target, z_Database* db, size_t scratch_size, size_t workers, z_Directory* expected)
+{
+    pid_t pid = fork();
+    if (!pid) {
+        // quiet the out of memory message, running out is expected while searching for the smallest scratch
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        char* memory = malloc(scratch_size);
+        Arena scratch = {.start = memory, .end = memory + scratch_size};
+        char* cwd = "/home/user";
+        z_Directory* match = workers ? z_match_find_parallel(target, strlen(target) + 1, cwd, strlen(cwd) + 1, db,
+                                                             &scratch, workers)
+                                     : z_match_find(target, strlen(target) + 1, cwd, strlen(cwd) + 1, db, &scratch);
+        _exit(match == expected ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+// a database scored in parallel fits in the same scratch as the serial scan, 'make test_z' lowers
+// Z_PARALLEL_THRESHOLD so this database is over it
+void z_match_find_parallel_scratch_test()
+{
+    ARENA_TEST_SETUP;
+    SCRATCH_ARENA_TEST_SETUP;
+
+    z_Database db = {0};
+    time_t now = time(NULL);
+    for (size_t i = 0; i < Z_DATABASE_IN_MEMORY_LIMIT - 1; ++i) {
+        z_Directory* dir = db.dirs + i;
+        dir->path = arena_malloc(&arena, 64, char);
+        int len = snprintf(dir->path, 64, "/home/user/proj%zu/src", i);
+        dir->path_length = (size_t)len + 1;
+        dir->rank = (double)(i % 7 + 1);
+        dir->last_accessed = now - (time_t)(i % 5) * Z_DAY;
+        ++db.count;
+    }
+
+    char* target = "pjsrc";
+    Arena scratch = scratch_arena;
+    z_Directory* serial = z_match_find_parallel(target, strlen(target) + 1, "/home/user", sizeof("/home/user"), &db,
+                                                &scratch, 1);
+    eassert(serial);
+
+    // the smallest scratch the serial scan fits in
+    size_t too_small = 0;
+    size_t fits = 1 << 16;
+    eassert(z_match_in_child(target, &db, fits, 1, serial));
+    while (fits - too_small > 16) {
+        size_t middle = too_small + (fits - too_small) / 2;
+        if (z_match_in_child(target, &db, middle, 1, serial)) {
+            fits = middle;
+        }
+        else {
+            too_small = middle;
+        }
+    }
+
+    eassert(z_match_in_child(target, &db, fits, 0, serial));
+    eassert(z_match_in_child(target, &db, fits, Z_PARALLEL_WORKERS, serial));
+
+    ARENA_TEST_TEARDOWN;
+    SCRATCH_ARENA_TEST_TEARDOWN;
+}
+
 void z_change_directory_test()
 {
     ARENA_TEST_SETUP;
@@ -730,6 +1455,34 @@ void z_crashing_input_test()
     SCRATCH_ARENA_TEST_TEARDOWN;
 }
 
+// an embedding keeps one context for its lifetime and only touches the database file on flush
+void z_context_test()
+{
+    remove(Z_DATABASE_FILE);
+    z_Context* context = z_context_new(&config_location);
+    eassert(context);
+    z_Database* db = z_context_database(context);
+    eassert(!db->count);
+
+    eassert(z_context_visit(context, "/tmp", 5) == Z_SUCCESS);
+    eassert(z_context_visit(context, "/tmp", 5) == Z_SUCCESS);
+    eassert(db->count == 1 && db->dirs[0].rank == 2);
+
+    char buffer[PATH_MAX];
+    Str output = Str_New(buffer, sizeof(buffer));
+    char* keyword = "tmp";
+    size_t keyword_length = 4;
+    eassert(z_context_query(context, &keyword, &keyword_length, 1, "/", &output) == Z_SUCCESS);
+    eassert(output.length == 5 && !memcmp(output.value, "/tmp", 5));
+
+    eassert(z_context_flush(context) == Z_SUCCESS);
+    eassert(!db->dirty);
+    eassert(z_context_remove(context, "/tmp", 5) == Z_SUCCESS);
+    eassert(z_context_remove(context, "/tmp", 5) == Z_MATCH_NOT_FOUND);
+    eassert(z_context_free(context) == Z_SUCCESS);
+    remove(Z_DATABASE_FILE);
+}
+
 int main()
 {
     etest_start();
@@ -745,6 +1498,22 @@ int main()
     etest_run(z_match_find_finds_match_test);
     etest_run(z_match_find_no_match_test);
     etest_run(z_match_find_multiple_matches_test);
+    etest_run(z_frecency_decay_test);
+    etest_run(z_match_find_parallel_matches_serial_test);
+    etest_run(z_match_find_pruned_matches_full_scan_test);
+    etest_run(z_match_find_parallel_scratch_test);
+    etest_run(z_basename_find_test);
+    etest_run(z_keywords_match_find_test);
+    etest_run(z_query_cache_test);
+    etest_run(z_directory_match_exists_test);
+    etest_run(z_read_level_test);
+    etest_run(z_journal_replay_test);
+    etest_run(z_journal_replay_late_append_test);
+    etest_run(z_read_full_database_test);
+    etest_run(z_database_remove_reuses_path_test);
+    etest_run(z_resolve_test);
+    etest_run(z_daemon_serve_test);
+    etest_run(z_daemon_private_test);
 
     etest_run(z_change_directory_test);
     etest_run(z_home_empty_target_change_directory_test);
@@ -762,6 +1531,7 @@ int main()
     etest_run(z_add_new_entry_contained_in_another_entry_but_different_test);
     etest_run(z_contains_correct_match_test);
     etest_run(z_crashing_input_test);
+    etest_run(z_context_test);
 
     etest_finish();
 
@@ -8,7 +8,10 @@
 #define _DEFAULT_SOURCE
 
 #include "help.c"
+#include "z_shell.c"
 #include "fzf.c"
 #include "z.c"
+#include "z_daemon.c"
+#include "z_trace.c"
 #include "arena.c"
-#include "main.c"
+#include "z_main.c"
@@ -7,10 +7,17 @@
 #endif                  /* ifndef _DEFAULT_SOURCE */
 
 #include <assert.h>
+#include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -18,26 +25,81 @@
 #include "ecolors.h"
 #include "fzf.h"
 #include "z.h"
+#include "z_trace.h"
+
+/* z_frecency_weight
+ * How much an entrys rank counts for given the seconds since it was last accessed.
+ * By default the weight is 4 for entries accessed within the last hour, like the original buckets, so entries visited
+ * moments apart still tie. After that it decays continuously towards 0.25, halving its distance to 0.25 every
+ * Z_FRECENCY_HALF_LIFE seconds. Building with Z_FRECENCY_BUCKETS keeps the original hour/day/week steps instead.
+ * Both are branch free so the pass over all entries in z_frecencies can be vectorised.
+ */
+static inline double z_frecency_weight(double age)
+{
+#ifdef Z_FRECENCY_BUCKETS
+    return 0.25 + 0.25 * (age < Z_WEEK) + 1.5 * (age < Z_DAY) + 2.0 * (age < Z_HOUR);
+#else
+    return 0.25 + 3.75 * exp2(-fmax(age - Z_HOUR, 0.0) / Z_FRECENCY_HALF_LIFE);
+#endif /* ifdef Z_FRECENCY_BUCKETS */
+}
 
-double z_score(z_Directory* restrict directory, int fzf_score, time_t now)
+/* z_frecency
+ * The frecency term of z_score, the directories rank weighted by how recently it was accessed.
+ */
+double z_frecency(z_Directory* restrict directory, time_t now)
 {
     assert(directory);
-    assert(fzf_score > 0);
 
-    time_t duration = now - directory->last_accessed;
+    return directory->rank * z_frecency_weight((double)(now - directory->last_accessed));
+}
 
-    if (duration < Z_HOUR) {
-        return (directory->rank * 4.0) + fzf_score;
-    }
-    else if (duration < Z_DAY) {
-        return (directory->rank * 2.0) + fzf_score;
+/* z_frecencies
+ * The frecency of dirs[0, count) in one pass. Ranks and ages are gathered into flat arrays first so the weighting
+ * loop runs over contiguous doubles.
+ */
+void z_frecencies(z_Directory* restrict dirs, size_t count, time_t now, double* restrict frecencies,
+                  Arena scratch_arena)
+{
+    assert(dirs && frecencies);
+
+    double* ages = arena_malloc(&scratch_arena, count, double);
+    for (size_t i = 0; i < count; ++i) {
+        frecencies[i] = dirs[i].rank;
+        ages[i] = (double)(now - dirs[i].last_accessed);
     }
-    else if (duration < Z_WEEK) {
-        return (directory->rank * 0.5) + fzf_score;
+
+    for (size_t i = 0; i < count; ++i) {
+        frecencies[i] *= z_frecency_weight(ages[i]);
     }
-    else {
-        return (directory->rank * 0.25) + fzf_score;
+}
+
+double z_score(z_Directory* restrict directory, int fzf_score, time_t now)
+{
+    assert(directory);
+    assert(fzf_score > 0);
+
+    return z_frecency(directory, now) + fzf_score;
+}
+
+/* z_database_bump
+ * Record a visit to dir. Cached answers where dir is the winner only get stronger so they stay valid, any other cached
+ * answer could now be beaten by dir so the generation moves on without them.
+ */
+void z_database_bump(z_Directory* dir, z_Database* db)
+{
+    assert(dir && db && dir >= db->dirs && dir < db->dirs + db->count);
+
+    ++dir->rank;
+    dir->last_accessed = time(NULL);
+    db->dirty = true;
+
+    uint32_t entry = (uint32_t)(dir - db->dirs) + 1;
+    for (size_t i = 0; i < Z_QUERY_CACHE_SLOTS; ++i) {
+        if (db->query_cache[i].entry == entry && db->query_cache[i].generation == db->generation) {
+            ++db->query_cache[i].generation;
+        }
     }
+    ++db->generation;
 }
 
 bool z_match_exists(char* restrict target, size_t target_length, z_Database* restrict db)
@@ -46,8 +108,7 @@ bool z_match_exists(char* restrict target, size_t target_length, z_Database* res
 
     for (size_t i = 0; i < db->count; ++i) {
         if (estrcmp((db->dirs + i)->path, (db->dirs + i)->path_length, target, target_length)) {
-            ++(db->dirs + i)->rank;
-            (db->dirs + i)->last_accessed = time(NULL);
+            z_database_bump(db->dirs + i, db);
             return true;
         }
     }
@@ -55,47 +116,632 @@ bool z_match_exists(char* restrict target, size_t target_length, z_Database* res
     return false;
 }
 
-z_Directory* z_match_find(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length, z_Database* restrict db,
-                          Arena* restrict scratch_arena)
+/* z_basename
+ * The last component of path, ignoring trailing slashes. path_length includes the null terminator.
+ */
+char* z_basename(char* restrict path, size_t path_length, size_t* restrict basename_length)
 {
-    assert(target && target_length && cwd && cwd_length && scratch_arena && db);
-    if (!db->count || cwd_length < 2) {
-        return NULL;
+    assert(path && path_length && basename_length);
+
+    size_t end = path_length - 1;
+    while (end > 1 && path[end - 1] == '/') {
+        --end;
+    }
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') {
+        --start;
+    }
+
+    *basename_length = end - start;
+    return path + start;
+}
+
+#define Z_FNV_OFFSET 14695981039346656037ULL
+#define Z_FNV_PRIME 1099511628211ULL
+
+/* z_basename_index_insert
+ * Chain entry i under each lowercased prefix of its basename, up to Z_BASENAME_PREFIX_MAX characters.
+ */
+void z_basename_index_insert(size_t i, z_Database* restrict db)
+{
+    z_Basename_Index* index = &db->basename_index;
+    size_t basename_length;
+    char* basename = z_basename(db->dirs[i].path, db->dirs[i].path_length, &basename_length);
+
+    uint64_t hash = Z_FNV_OFFSET;
+    for (size_t p = 0; p < basename_length && p < Z_BASENAME_PREFIX_MAX; ++p) {
+        hash = (hash ^ (uint8_t)tolower((uint8_t)basename[p])) * Z_FNV_PRIME;
+        size_t node = i * Z_BASENAME_PREFIX_MAX + p;
+        size_t bucket = hash % Z_BASENAME_BUCKETS;
+        index->next[node] = index->buckets[bucket];
+        index->buckets[bucket] = (uint32_t)node + 1;
+    }
+}
+
+/* z_basename_index_update
+ * Index any entries added since the last update. Removing entries shifts indexes so z_remove resets the count to 0,
+ * which rebuilds the index from scratch here.
+ */
+void z_basename_index_update(z_Database* restrict db)
+{
+    z_Basename_Index* index = &db->basename_index;
+    if (!index->count || index->count > db->count) {
+        memset(index->buckets, 0, sizeof(index->buckets));
+        index->count = 0;
+    }
+
+    for (; index->count < db->count; ++index->count) {
+        if (db->dirs[index->count].path) {
+            z_basename_index_insert(index->count, db);
+        }
+    }
+}
+
+/* z_basename_best
+ * The highest frecency entry whose basename equals target, or failing that starts with target, ignoring case.
+ * Only walks the chain for targets first Z_BASENAME_PREFIX_MAX characters instead of scanning the database.
+ * The z_score of the match is its frecency, the runner up is the next best frecency of the same kind of hit.
+ */
+z_Match z_basename_best(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                        z_Database* restrict db, time_t now)
+{
+    assert(target && target_length > 1);
+    z_basename_index_update(db);
+    z_Basename_Index* index = &db->basename_index;
+
+    size_t length = target_length - 1;
+    size_t key_length = length < Z_BASENAME_PREFIX_MAX ? length : Z_BASENAME_PREFIX_MAX;
+    uint64_t hash = Z_FNV_OFFSET;
+    for (size_t p = 0; p < key_length; ++p) {
+        hash = (hash ^ (uint8_t)tolower((uint8_t)target[p])) * Z_FNV_PRIME;
+    }
+
+    z_Match exact = {0};
+    z_Match prefix = {0};
+    for (uint32_t node = index->buckets[hash % Z_BASENAME_BUCKETS]; node; node = index->next[node - 1]) {
+        if ((node - 1) % Z_BASENAME_PREFIX_MAX + 1 != key_length) {
+            continue;
+        }
+
+        z_Directory* dir = db->dirs + (node - 1) / Z_BASENAME_PREFIX_MAX;
+        size_t basename_length;
+        char* basename = z_basename(dir->path, dir->path_length, &basename_length);
+        if (basename_length < length || strncasecmp(basename, target, length) ||
+            estrcmp(dir->path, dir->path_length, cwd, cwd_length)) {
+            continue;
+        }
+
+        // chains are newest first, so on equal frecency the lower index is visited last and wins with >=
+        double frecency = z_frecency(dir, now);
+        z_Match* best = basename_length == length ? &exact : &prefix;
+        if (!best->dir || frecency >= best->z_score) {
+            best->runner_up = best->dir ? fmax(best->runner_up, best->z_score) : best->runner_up;
+            best->z_score = frecency;
+            best->dir = dir;
+        }
+        else {
+            best->runner_up = fmax(best->runner_up, frecency);
+        }
+    }
+
+    return exact.dir ? exact : prefix;
+}
+
+z_Directory* z_basename_find(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                             z_Database* restrict db, time_t now)
+{
+    return z_basename_best(target, target_length, cwd, cwd_length, db, now).dir;
+}
+
+/* z_target_is_plain
+ * Targets without fzf operators, spaces, or slashes can be looked up by basename.
+ */
+bool z_target_is_plain(char* restrict target, size_t target_length)
+{
+    for (size_t i = 0; i + 1 < target_length; ++i) {
+        if (strchr(" \t/!'^$|\\", target[i])) {
+            return false;
+        }
+    }
+    return target_length > 1;
+}
+
+typedef struct {
+    size_t begin;
+    size_t end;
+    fzf_pattern_t* pattern;
+    char* cwd;
+    size_t cwd_length;
+    z_Database* db;
+    time_t now;
+    Arena scratch_arena;
+    z_Match match;
+} z_Match_Worker;
+
+typedef struct {
+    double frecency;
+    size_t index;
+} z_Candidate;
+
+/* z_candidate_compare
+ * Highest frecency first, lowest index first for equal frecency so the scan order is deterministic.
+ */
+int z_candidate_compare(const void* lhs, const void* rhs)
+{
+    const z_Candidate* a = lhs;
+    const z_Candidate* b = rhs;
+    if (a->frecency != b->frecency) {
+        return a->frecency < b->frecency ? 1 : -1;
+    }
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+// scratch z_match_range allocates for each entry in its range, its age and frecency in z_frecencies and a candidate
+#define Z_MATCH_ENTRY_SCRATCH (2 * sizeof(double) + sizeof(z_Candidate))
+
+#define Z_MATCH_BLOCK 64
+
+/* z_match_range
+ * Find the best match in db->dirs[begin, end), the first entry wins ties.
+ * Candidates are scanned by descending frecency, scoring stops as soon as frecency plus the patterns maximum possible
+ * fzf score can't beat the current best, so on large databases most entries are never fuzzy matched.
+ * Uses only the workers own scratch arena so multiple workers can run concurrently.
+ */
+void z_match_range(z_Match_Worker* restrict worker)
+{
+    assert(worker && worker->pattern && worker->db);
+    z_Database* db = worker->db;
+    Arena* scratch_arena = &worker->scratch_arena;
+    size_t count = worker->end - worker->begin;
+    if (!count) {
+        return;
     }
 
     fzf_slab_t* slab = fzf_make_slab((fzf_slab_config_t){(size_t)1 << 6, 1 << 6}, scratch_arena);
-    fzf_pattern_t* pattern = fzf_parse_pattern(target, target_length - 1, scratch_arena);
-    z_Match current_match = {0};
-    time_t now = time(NULL);
-#ifdef Z_DEBUG
-    printf("cwd %s, len %zu\n", cwd, cwd_length);
-#endif
+    double* frecencies = arena_malloc(scratch_arena, count, double);
+    z_frecencies(db->dirs + worker->begin, count, worker->now, frecencies, *scratch_arena);
+
+    z_Candidate* candidates = arena_malloc(scratch_arena, count, z_Candidate);
+    size_t candidates_count = 0;
+    for (size_t i = worker->begin; i < worker->end; ++i) {
+        if (!estrcmp((db->dirs + i)->path, (db->dirs + i)->path_length, worker->cwd, worker->cwd_length)) {
+            candidates[candidates_count++] = (z_Candidate){.frecency = frecencies[i - worker->begin], .index = i};
+        }
+    }
+    qsort(candidates, candidates_count, sizeof(z_Candidate), z_candidate_compare);
+
+    const double max_fzf_score = fzf_max_score(worker->pattern) + Z_BASENAME_BONUS;
+    size_t match_index = 0;
+    const char* texts[Z_MATCH_BLOCK];
+    size_t lens[Z_MATCH_BLOCK];
+    int32_t fzf_scores[Z_MATCH_BLOCK];
+    for (size_t next = 0; next < candidates_count;) {
+        size_t block_start = next;
+        for (; next < candidates_count && next - block_start < Z_MATCH_BLOCK; ++next) {
+            // sorted by frecency, so once one candidate can't win none of the rest can either
+            if (worker->match.dir && candidates[next].frecency + max_fzf_score < worker->match.z_score) {
+                worker->match.runner_up = fmax(worker->match.runner_up, candidates[next].frecency + max_fzf_score);
+                candidates_count = next;
+                break;
+            }
+            z_Directory* dir = db->dirs + candidates[next].index;
+            texts[next - block_start] = dir->path;
+            lens[next - block_start] = dir->path_length - 1;
+        }
 
-    for (size_t i = 0; i < db->count; ++i) {
-        if (!estrcmp((db->dirs + i)->path, (db->dirs + i)->path_length, cwd, cwd_length)) {
-            int fzf_score =
-                fzf_get_score((db->dirs + i)->path, (db->dirs + i)->path_length - 1, pattern, slab, scratch_arena);
+        fzf_get_scores(texts, lens, next - block_start, worker->pattern, fzf_scores, slab, scratch_arena);
+
+        for (size_t k = block_start; k < next; ++k) {
+            int fzf_score = fzf_scores[k - block_start];
             if (!fzf_score)
                 continue;
 
-            double potential_match_z_score = z_score((db->dirs + i), fzf_score, now);
+            size_t i = candidates[k].index;
+            double potential_match_z_score = candidates[k].frecency + fzf_score;
+#if Z_BASENAME_BONUS
+            size_t basename_length;
+            char* basename = z_basename((db->dirs + i)->path, (db->dirs + i)->path_length, &basename_length);
+            Arena_Mark mark = arena_mark(scratch_arena);
+            if (fzf_get_score(basename, basename_length, worker->pattern, slab, scratch_arena)) {
+                potential_match_z_score += Z_BASENAME_BONUS;
+            }
+            arena_restore(scratch_arena, mark);
+#endif /* if Z_BASENAME_BONUS */
 #ifdef Z_DEBUG
             printf("%zu %s len: %zu\n", i, (db->dirs + i)->path, (db->dirs + i)->path_length);
             printf("%s fzf_score %d\n", (db->dirs + i)->path, fzf_score);
             printf("%s z_score %f\n", (db->dirs + i)->path, potential_match_z_score);
 #endif /* ifdef Z_DEBUG */
 
-            if (!current_match.dir || current_match.z_score < potential_match_z_score) {
-                current_match.z_score = potential_match_z_score;
-                current_match.dir = (db->dirs + i);
+            if (!worker->match.dir || worker->match.z_score < potential_match_z_score ||
+                (worker->match.z_score == potential_match_z_score && i < match_index)) {
+                if (worker->match.dir) {
+                    worker->match.runner_up = fmax(worker->match.runner_up, worker->match.z_score);
+                }
+                worker->match.z_score = potential_match_z_score;
+                worker->match.dir = (db->dirs + i);
+                match_index = i;
+            }
+            else {
+                worker->match.runner_up = fmax(worker->match.runner_up, potential_match_z_score);
             }
         }
     }
+}
+
+void* z_match_range_thread(void* worker)
+{
+    z_match_range(worker);
+    return NULL;
+}
+
+/* z_match_workers
+ * How many of workers can each score their range of count entries in an equal share of the scratch arena.
+ * The last range is the longest, and a share too small for it would run out of memory where a serial scan wouldn't.
+ */
+static size_t z_match_workers(size_t workers, size_t count, Arena* restrict scratch_arena)
+{
+    size_t scratch_size = (uintptr_t)scratch_arena->end - (uintptr_t)scratch_arena->start;
+    while (workers > 1) {
+        size_t last_range = count - (workers - 1) * (count / workers);
+        if (scratch_size / workers >= Z_MATCH_WORKER_SCRATCH + last_range * Z_MATCH_ENTRY_SCRATCH) {
+            break;
+        }
+        --workers;
+    }
+    return workers;
+}
+
+/* z_match_best
+ * Partitions db->dirs into contiguous ranges scored by up to workers threads.
+ * The calling thread scores the first range and each worker gets an equal share of the scratch arena. Results are merged in range order so ties resolve to the
+ * first entry, exactly like the serial scan.
+ */
+z_Match z_match_best(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                     z_Database* restrict db, Arena* restrict scratch_arena, size_t workers)
+{
+    assert(target && target_length && cwd && cwd_length && scratch_arena && db);
+    if (!db->count || cwd_length < 2) {
+        return (z_Match){0};
+    }
+
+    if (!workers) {
+        workers = 1;
+    }
+    if (workers > Z_PARALLEL_WORKERS) {
+        workers = Z_PARALLEL_WORKERS;
+    }
+    if (workers > db->count) {
+        workers = db->count;
+    }
 
+    uint64_t start = z_trace_begin();
+    fzf_pattern_t* pattern = fzf_parse_pattern(target, target_length - 1, scratch_arena);
+    z_trace_end("parse", start);
+    arena_ensure(scratch_arena, Z_MATCH_SCRATCH_SIZE + db->count * Z_MATCH_ENTRY_SCRATCH);
+    workers = z_match_workers(workers, db->count, scratch_arena);
+    time_t now = time(NULL);
 #ifdef Z_DEBUG
-    printf("match %s\n", current_match.dir->path);
+    printf("cwd %s, len %zu\n", cwd, cwd_length);
+#endif
+
+    z_Match_Worker pool[Z_PARALLEL_WORKERS] = {0};
+    pthread_t threads[Z_PARALLEL_WORKERS];
+    bool started[Z_PARALLEL_WORKERS] = {0};
+    size_t per_worker = db->count / workers;
+    size_t scratch_share = ((uintptr_t)scratch_arena->end - (uintptr_t)scratch_arena->start) / workers;
+    for (size_t w = 0; w < workers; ++w) {
+        char* share = scratch_arena->start + w * scratch_share;
+        pool[w] = (z_Match_Worker){.begin = w * per_worker,
+                                   .end = w + 1 == workers ? db->count : (w + 1) * per_worker,
+                                   .pattern = pattern,
+                                   .cwd = cwd,
+                                   .cwd_length = cwd_length,
+                                   .db = db,
+                                   .now = now,
+                                   .scratch_arena = {.start = share, .end = share + scratch_share}};
+    }
+
+    start = z_trace_begin();
+    for (size_t w = 1; w < workers; ++w) {
+        started[w] = !pthread_create(threads + w, NULL, z_match_range_thread, pool + w);
+    }
+    z_match_range(pool);
+
+    z_Match current_match = pool[0].match;
+    for (size_t w = 1; w < workers; ++w) {
+        if (started[w]) {
+            pthread_join(threads[w], NULL);
+        }
+        else {
+            // couldn't start the thread, score its range here instead
+            z_match_range(pool + w);
+        }
+
+        if (!pool[w].match.dir) {
+            continue;
+        }
+
+        double runner_up = fmax(current_match.runner_up, pool[w].match.runner_up);
+        if (!current_match.dir || current_match.z_score < pool[w].match.z_score) {
+            runner_up = fmax(runner_up, current_match.z_score);
+            current_match = pool[w].match;
+        }
+        else {
+            runner_up = fmax(runner_up, pool[w].match.z_score);
+        }
+        current_match.runner_up = runner_up;
+    }
+    z_trace_end("score", start);
+
+#ifdef Z_DEBUG
+    if (current_match.dir) {
+        printf("match %s\n", current_match.dir->path);
+    }
 #endif /* ifdef Z_DEBUG */
 
+    return current_match;
+}
+
+z_Directory* z_match_find_parallel(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                                   z_Database* restrict db, Arena* restrict scratch_arena, size_t workers)
+{
+    return z_match_best(target, target_length, cwd, cwd_length, db, scratch_arena, workers).dir;
+}
+
+z_Match z_match_find_ranked(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                            z_Database* restrict db, Arena* restrict scratch_arena)
+{
+    if (db->count && cwd_length > 1 && z_target_is_plain(target, target_length)) {
+        uint64_t start = z_trace_begin();
+        z_Match basename_match = z_basename_best(target, target_length, cwd, cwd_length, db, time(NULL));
+        z_trace_end("basename", start);
+        if (basename_match.dir) {
+            return basename_match;
+        }
+    }
+
+    // small databases don't pay for thread startup
+    size_t workers = db->count >= Z_PARALLEL_THRESHOLD ? Z_PARALLEL_WORKERS : 1;
+    return z_match_best(target, target_length, cwd, cwd_length, db, scratch_arena, workers);
+}
+
+z_Directory* z_match_find(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length,
+                          z_Database* restrict db, Arena* restrict scratch_arena)
+{
+    return z_match_find_ranked(target, target_length, cwd, cwd_length, db, scratch_arena).dir;
+}
+
+#define Z_QUERY_CACHE_MAGIC 0x3143515AU // "ZQC1"
+
+/* z_query_cache_key
+ * Hash of the pattern and cwd. Whitespace in the pattern is trimmed and collapsed since fzf splits terms on it,
+ * unless escaped, and trailing slashes on the cwd are ignored.
+ */
+uint64_t z_query_cache_key(char* restrict target, size_t target_length, char* restrict cwd, size_t cwd_length)
+{
+    assert(target && target_length && cwd && cwd_length);
+
+    uint64_t hash = Z_FNV_OFFSET;
+    bool pending_space = false;
+    bool started = false;
+    for (size_t i = 0; i + 1 < target_length; ++i) {
+        bool escaped = i && target[i - 1] == '\\';
+        if (isspace((uint8_t)target[i]) && !escaped) {
+            pending_space = started;
+            continue;
+        }
+        if (pending_space) {
+            hash = (hash ^ (uint8_t)' ') * Z_FNV_PRIME;
+            pending_space = false;
+        }
+        started = true;
+        hash = (hash ^ (uint8_t)target[i]) * Z_FNV_PRIME;
+    }
+
+    hash = (hash ^ (uint8_t)'\0') * Z_FNV_PRIME;
+    size_t cwd_end = cwd_length - 1;
+    while (cwd_end > 1 && cwd[cwd_end - 1] == '/') {
+        --cwd_end;
+    }
+    for (size_t i = 0; i < cwd_end; ++i) {
+        hash = (hash ^ (uint8_t)cwd[i]) * Z_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* z_query_cache_find
+ * The cached winner for key if it is still the answer and still a directory, otherwise NULL.
+ */
+z_Directory* z_query_cache_find(uint64_t key, z_Database* restrict db, time_t now)
+{
+    assert(db);
+
+    z_Query_Cache_Slot* slot = db->query_cache + key % Z_QUERY_CACHE_SLOTS;
+    if (slot->key != key || !slot->entry || slot->entry > db->count || slot->generation != db->generation) {
+        return NULL;
+    }
+
+    z_Directory* dir = db->dirs + slot->entry - 1;
+    if (!dir->path || slot->frecency - z_frecency(dir, now) >= slot->margin) {
+        return NULL;
+    }
+
+    struct stat sb;
+    if (stat(dir->path, &sb) || !S_ISDIR(sb.st_mode)) {
+        return NULL;
+    }
+
+    return dir;
+}
+
+void z_query_cache_store(uint64_t key, z_Match* restrict match, z_Database* restrict db, time_t now)
+{
+    assert(match && match->dir && db);
+
+    db->dirty = true;
+    db->query_cache[key % Z_QUERY_CACHE_SLOTS] = (z_Query_Cache_Slot){
+        .key = key,
+        .generation = db->generation,
+        .entry = (uint32_t)(match->dir - db->dirs) + 1,
+        .frecency = z_frecency(match->dir, now),
+        .margin = match->z_score - match->runner_up,
+    };
+}
+
+z_Directory* z_query(char* restrict target, size_t target_length, char* restrict cwd, z_Database* restrict db,
+                     Arena scratch_arena)
+{
+    assert(target && target_length && cwd && db);
+
+    size_t cwd_length = strlen(cwd) + 1;
+    time_t now = time(NULL);
+    uint64_t start = z_trace_begin();
+    uint64_t key = z_query_cache_key(target, target_length, cwd, cwd_length);
+    z_Directory* match = z_query_cache_find(key, db, now);
+    z_trace_end("cache", start);
+    if (match) {
+        return match;
+    }
+
+    z_Match ranked = z_match_find_ranked(target, target_length, cwd, cwd_length, db, &scratch_arena);
+    if (ranked.dir) {
+        z_query_cache_store(key, &ranked, db, now);
+    }
+    return ranked.dir;
+}
+
+/* z_Keywords
+ * The compiled form of a multi keyword query like `z proj api`.
+ * Every keyword but the last must appear in order as a substring of the path, the last keyword is fuzzy matched
+ * against the final path component after the earlier keywords. Keywords use smart case like fzf patterns.
+ */
+typedef struct {
+    size_t count; // keywords before the last
+    char** keywords;
+    size_t* keyword_lengths; // without the null terminator
+    bool* case_sensitive;
+    fzf_pattern_t* last;
+} z_Keywords;
+
+z_Keywords z_keywords_compile(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                              Arena* restrict scratch_arena)
+{
+    assert(keywords && keyword_lengths && keywords_count > 1);
+
+    z_Keywords compiled = {.count = keywords_count - 1};
+    compiled.keywords = arena_malloc(scratch_arena, compiled.count, char*);
+    compiled.keyword_lengths = arena_malloc(scratch_arena, compiled.count, size_t);
+    compiled.case_sensitive = arena_malloc(scratch_arena, compiled.count, bool);
+    for (size_t i = 0; i < compiled.count; ++i) {
+        size_t length = keyword_lengths[i] - 1;
+        compiled.keyword_lengths[i] = length;
+        compiled.keywords[i] = arena_malloc(scratch_arena, length + 1, char);
+        compiled.case_sensitive[i] = false;
+        for (size_t j = 0; j < length; ++j) {
+            if (isupper((uint8_t)keywords[i][j])) {
+                compiled.case_sensitive[i] = true;
+                break;
+            }
+        }
+        for (size_t j = 0; j < length; ++j) {
+            compiled.keywords[i][j] =
+                compiled.case_sensitive[i] ? keywords[i][j] : (char)tolower((uint8_t)keywords[i][j]);
+        }
+    }
+
+    char* last = keywords[compiled.count];
+    compiled.last = fzf_parse_pattern(last, keyword_lengths[compiled.count] - 1, scratch_arena);
+    return compiled;
+}
+
+/* z_keywords_score
+ * A single left to right pass over the path: each keyword is searched for from where the previous one ended, then
+ * the last keyword is fuzzy scored against whatever remains of the final component. Returns 0 if there's no match.
+ */
+int z_keywords_score(z_Keywords* restrict compiled, z_Directory* restrict dir, fzf_slab_t* restrict slab,
+                     Arena* restrict scratch_arena)
+{
+    size_t length = dir->path_length - 1;
+    size_t cursor = 0;
+    for (size_t k = 0; k < compiled->count; ++k) {
+        size_t keyword_length = compiled->keyword_lengths[k];
+        char* keyword = compiled->keywords[k];
+        bool found = false;
+        for (; cursor + keyword_length <= length; ++cursor) {
+            size_t j = 0;
+            while (j < keyword_length) {
+                char c = dir->path[cursor + j];
+                if ((compiled->case_sensitive[k] ? c : (char)tolower((uint8_t)c)) != keyword[j]) {
+                    break;
+                }
+                ++j;
+            }
+            if (j == keyword_length) {
+                cursor += keyword_length;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return 0;
+        }
+    }
+
+    size_t basename_length;
+    char* basename = z_basename(dir->path, dir->path_length, &basename_length);
+    size_t start = (size_t)(basename - dir->path);
+    size_t end = start + basename_length;
+    if (cursor > start) {
+        start = cursor;
+    }
+    if (start >= end) {
+        return 0;
+    }
+
+    return fzf_get_score(dir->path + start, end - start, compiled->last, slab, scratch_arena);
+}
+
+z_Directory* z_keywords_match_find(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                                   char* restrict cwd, size_t cwd_length, z_Database* restrict db,
+                                   Arena* restrict scratch_arena)
+{
+    assert(keywords && keyword_lengths && cwd && db && scratch_arena);
+    if (!db->count || keywords_count < 2) {
+        return NULL;
+    }
+
+    uint64_t start = z_trace_begin();
+    z_Keywords compiled = z_keywords_compile(keywords, keyword_lengths, keywords_count, scratch_arena);
+    z_trace_end("parse", start);
+    fzf_slab_t* slab = fzf_make_slab((fzf_slab_config_t){(size_t)1 << 6, 1 << 6}, scratch_arena);
+    const double max_fzf_score = fzf_max_score(compiled.last);
+    time_t now = time(NULL);
+
+    z_Match current_match = {0};
+    Arena_Mark mark = arena_mark(scratch_arena);
+    start = z_trace_begin();
+    for (size_t i = 0; i < db->count; ++i) {
+        z_Directory* dir = db->dirs + i;
+        if (!dir->path || estrcmp(dir->path, dir->path_length, cwd, cwd_length)) {
+            continue;
+        }
+
+        double frecency = z_frecency(dir, now);
+        if (current_match.dir && frecency + max_fzf_score <= current_match.z_score) {
+            continue;
+        }
+
+        int fzf_score = z_keywords_score(&compiled, dir, slab, scratch_arena);
+        arena_restore(scratch_arena, mark);
+        if (fzf_score && (!current_match.dir || current_match.z_score < frecency + fzf_score)) {
+            current_match.z_score = frecency + fzf_score;
+            current_match.dir = dir;
+        }
+    }
+    z_trace_end("score", start);
+
     return current_match.dir;
 }
 
@@ -140,6 +786,33 @@ enum z_Result z_write_entry(z_Directory* restrict dir, FILE* restrict file)
     return Z_SUCCESS;
 }
 
+/* z_write_query_cache
+ * The query cache is written after the entries so older versions reading the file just ignore it:
+ * [magic][generation][slot count][slots]
+ */
+enum z_Result z_write_query_cache(z_Database* restrict db, FILE* restrict file)
+{
+    assert(db && file);
+
+    uint32_t magic = Z_QUERY_CACHE_MAGIC;
+    uint32_t slots = Z_QUERY_CACHE_SLOTS;
+    if (!fwrite(&magic, sizeof(uint32_t), 1, file) || !fwrite(&db->generation, sizeof(uint64_t), 1, file) ||
+        !fwrite(&slots, sizeof(uint32_t), 1, file)) {
+        return Z_FILE_ERROR;
+    }
+
+    for (size_t i = 0; i < Z_QUERY_CACHE_SLOTS; ++i) {
+        z_Query_Cache_Slot* slot = db->query_cache + i;
+        if (!fwrite(&slot->key, sizeof(uint64_t), 1, file) || !fwrite(&slot->generation, sizeof(uint64_t), 1, file) ||
+            !fwrite(&slot->entry, sizeof(uint32_t), 1, file) || !fwrite(&slot->frecency, sizeof(double), 1, file) ||
+            !fwrite(&slot->margin, sizeof(double), 1, file)) {
+            return Z_FILE_ERROR;
+        }
+    }
+
+    return ferror(file) ? Z_FILE_ERROR : Z_SUCCESS;
+}
+
 #define Z_ERROR_WRITING_TO_DB_MESSAGE "z: Error writing to z database file\n"
 
 enum z_Result z_write(z_Database* restrict db)
@@ -175,11 +848,76 @@ enum z_Result z_write(z_Database* restrict db)
         }
     }
 
+    if ((result = z_write_query_cache(db, file)) != Z_SUCCESS) {
+        fclose(file);
+        return result;
+    }
+
     fclose(file);
     return Z_SUCCESS;
 }
 
-enum z_Result z_read_entry(z_Directory* restrict dir, FILE* restrict file, Arena* restrict arena)
+/* z_path_class
+ * The smallest size class size bytes fit in and its size, Z_PATH_CLASSES if it is too long for all of them.
+ * Classes alternate between powers of two and one and a half times the power below, so at most a third is wasted.
+ */
+static size_t z_path_class(size_t size, size_t* restrict class_size)
+{
+    size_t class = 0;
+    for (size_t power = Z_PATH_CLASS_MIN; power <= Z_PATH_CLASS_MAX; power *= 2, class += 2) {
+        if (size <= power) {
+            *class_size = power;
+            return class;
+        }
+        if (power < Z_PATH_CLASS_MAX && size <= power + power / 2) {
+            *class_size = power + power / 2;
+            return class + 1;
+        }
+    }
+
+    *class_size = size;
+    return Z_PATH_CLASSES;
+}
+
+/* z_path_alloc
+ * Memory for a path of size bytes, taken from the free list of its size class when a removed path left one there.
+ */
+static char* z_path_alloc(z_Path_Pool* restrict pool, size_t size, Arena* restrict arena)
+{
+    size_t class_size;
+    size_t class = z_path_class(size, &class_size);
+    if (class == Z_PATH_CLASSES) {
+        return arena_malloc(arena, size, char);
+    }
+
+    z_Path_Block* block = pool->free[class];
+    if (block) {
+        pool->free[class] = block->next;
+        return (char*)block;
+    }
+    // allocated as blocks so they are aligned for the next pointer once they are freed
+    return (char*)arena_malloc(arena, class_size / sizeof(z_Path_Block), z_Path_Block);
+}
+
+/* z_path_free
+ * Put the memory of an entrys path on the free list of its size class. size is the entrys path_length, every path
+ * was allocated with at least that many bytes so its block is at least as big as that class.
+ */
+static void z_path_free(z_Path_Pool* restrict pool, char* restrict path, size_t size)
+{
+    size_t class_size;
+    size_t class = z_path_class(size, &class_size);
+    if (!path || class == Z_PATH_CLASSES) {
+        return;
+    }
+
+    z_Path_Block* block = (z_Path_Block*)path;
+    block->next = pool->free[class];
+    pool->free[class] = block;
+}
+
+enum z_Result z_read_entry(z_Directory* restrict dir, FILE* restrict file, z_Path_Pool* restrict pool,
+                           Arena* restrict arena)
 {
     assert(dir && file);
 
@@ -210,7 +948,7 @@ enum z_Result z_read_entry(z_Directory* restrict dir, FILE* restrict file, Arena
         return Z_FILE_ERROR;
     }
 
-    dir->path = arena_malloc(arena, dir->path_length + 1, char);
+    dir->path = z_path_alloc(pool, dir->path_length + 1, arena);
 
     bytes_read = fread(dir->path, sizeof(char), dir->path_length, file);
     if (!bytes_read) {
@@ -224,6 +962,38 @@ enum z_Result z_read_entry(z_Directory* restrict dir, FILE* restrict file, Arena
     return Z_SUCCESS;
 }
 
+/* z_read_query_cache
+ * Reads the query cache after the entries if there is one. Databases without it or with a different slot count just
+ * start with an empty cache, so failures here aren't errors.
+ */
+void z_read_query_cache(z_Database* restrict db, FILE* restrict file)
+{
+    assert(db && file);
+
+    uint32_t magic = 0;
+    uint32_t slots = 0;
+    uint64_t generation = 0;
+    if (!fread(&magic, sizeof(uint32_t), 1, file) || magic != Z_QUERY_CACHE_MAGIC ||
+        !fread(&generation, sizeof(uint64_t), 1, file) || !fread(&slots, sizeof(uint32_t), 1, file)) {
+        return;
+    }
+
+    db->generation = generation;
+    if (slots != Z_QUERY_CACHE_SLOTS) {
+        return;
+    }
+
+    for (size_t i = 0; i < Z_QUERY_CACHE_SLOTS; ++i) {
+        z_Query_Cache_Slot* slot = db->query_cache + i;
+        if (!fread(&slot->key, sizeof(uint64_t), 1, file) || !fread(&slot->generation, sizeof(uint64_t), 1, file) ||
+            !fread(&slot->entry, sizeof(uint32_t), 1, file) || !fread(&slot->frecency, sizeof(double), 1, file) ||
+            !fread(&slot->margin, sizeof(double), 1, file)) {
+            memset(db->query_cache, 0, sizeof(db->query_cache));
+            return;
+        }
+    }
+}
+
 #define Z_OUTPUT_FAILURE "z: error writing output\n"
 #define Z_CREATING_DB_FILE_MESSAGE "z: trying to create z database file.\n"
 #define Z_CREATED_DB_FILE "z: created z database file.\n"
@@ -231,8 +1001,16 @@ enum z_Result z_read_entry(z_Directory* restrict dir, FILE* restrict file, Arena
     "z: couldn't find number of entries header while trying to read z database file. File is empty or "           \
     "corrupted.\n"
 
-enum z_Result z_read(z_Database* restrict db, Arena* restrict arena)
+/* z_read_file
+ * Read the database file, see z_read_level.
+ */
+enum z_Result z_read_file(z_Database* restrict db, Arena* restrict arena, enum z_Load level)
 {
+    db->loaded = level;
+    if (level == Z_LOAD_NONE) {
+        return Z_SUCCESS;
+    }
+
     FILE* file = fopen(db->database_file, "rb");
 
     if (!file || feof(file) || ferror(file)) {
@@ -296,44 +1074,207 @@ enum z_Result z_read(z_Database* restrict db, Arena* restrict arena)
         return Z_SUCCESS;
     }
 
-    enum z_Result result;
-    for (uint32_t i = 0; i < number_of_entries && number_of_entries < Z_DATABASE_IN_MEMORY_LIMIT && !feof(file); ++i) {
-        if ((result = z_read_entry((db->dirs + i), file, arena)) != Z_SUCCESS) {
-            fclose(file);
-            return result;
-        }
-#ifdef Z_DEBUG
-        printf("Rank: %f\n", (db->dirs + i)->rank);
-        printf("Last accessed: %ld\n", (db->dirs + i)->last_accessed);
-        printf("Path: %s\n", (db->dirs + i)->path);
-#endif /* ifdef Z_DEBUG */
+    if (level == Z_LOAD_HEADER) {
+        fclose(file);
+        db->count = number_of_entries;
+        return Z_SUCCESS;
+    }
+
+    // a file written with a higher limit only loads the entries which fit, which also leaves its query cache unreadable
+    uint32_t count = number_of_entries < Z_DATABASE_IN_MEMORY_LIMIT ? number_of_entries : Z_DATABASE_IN_MEMORY_LIMIT;
+    enum z_Result result;
+    for (uint32_t i = 0; i < count && !feof(file); ++i) {
+        if ((result = z_read_entry((db->dirs + i), file, &db->path_pool, arena)) != Z_SUCCESS) {
+            fclose(file);
+            return result;
+        }
+#ifdef Z_DEBUG
+        printf("Rank: %f\n", (db->dirs + i)->rank);
+        printf("Last accessed: %ld\n", (db->dirs + i)->last_accessed);
+        printf("Path: %s\n", (db->dirs + i)->path);
+#endif /* ifdef Z_DEBUG */
+    }
+
+    if (level == Z_LOAD_FULL && count == number_of_entries) {
+        z_read_query_cache(db, file);
+    }
+
+    fclose(file);
+
+    db->count = count;
+    return Z_SUCCESS;
+}
+
+
+enum z_Result z_write_entry_new(char* restrict path, size_t path_length, z_Database* restrict db, Arena* restrict arena)
+{
+    assert(path && db && path_length > 1);
+    assert(path[path_length - 1] == '\0');
+    if (db->count == Z_DATABASE_IN_MEMORY_LIMIT) {
+        return Z_FAILURE;
+    }
+
+    db->dirs[db->count].path = z_path_alloc(&db->path_pool, path_length, arena);
+
+    memcpy(db->dirs[db->count].path, path, path_length);
+    assert(db->dirs[db->count].path[path_length - 1] == '\0');
+
+    db->dirs[db->count].path_length = path_length;
+    ++db->dirs[db->count].rank;
+    db->dirs[db->count].last_accessed = time(NULL);
+    ++db->count;
+    ++db->generation;
+    db->dirty = true;
+
+    return Z_SUCCESS;
+}
+
+/* z_journal_path
+ * The database file name with suffix appended, false if it doesn't fit in buffer.
+ */
+bool z_journal_path(char* restrict database_file, char* restrict suffix, char* restrict buffer, size_t buffer_length)
+{
+    int length = snprintf(buffer, buffer_length, "%s%s", database_file, suffix);
+    return length >= 0 && (size_t)length < buffer_length;
+}
+
+// a hook whose journal was moved aside to be merged while it was opening it tries again with the new one
+#define Z_JOURNAL_ATTEMPTS 4
+
+/* z_journal_write
+ * Append record to journal. Writers hold a shared lock on the journal while appending and z_journal_replay holds an
+ * exclusive one on the file it merges, so a record either lands before the merge or in a journal which is still there.
+ */
+enum z_Result z_journal_write(char* restrict journal, z_Journal_Record* restrict record)
+{
+    for (size_t attempt = 0; attempt < Z_JOURNAL_ATTEMPTS; ++attempt) {
+        int fd = open(journal, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1) {
+            return Z_FILE_ERROR;
+        }
+
+        struct stat opened;
+        struct stat current;
+        if ((flock(fd, LOCK_SH | LOCK_NB) == -1 && errno == EWOULDBLOCK) || fstat(fd, &opened) == -1 ||
+            stat(journal, &current) == -1 || opened.st_dev != current.st_dev || opened.st_ino != current.st_ino) {
+            close(fd);
+            continue;
+        }
+
+        ssize_t bytes_written = write(fd, record, sizeof(*record));
+        close(fd);
+        return bytes_written == sizeof(*record) ? Z_SUCCESS : Z_FILE_ERROR;
+    }
+
+    return Z_FILE_ERROR;
+}
+
+enum z_Result z_journal_append(char* restrict database_file, char* restrict path, size_t path_length)
+{
+    assert(database_file && path);
+
+    z_Journal_Record record;
+    if (path_length < 2 || path_length > sizeof(record.path) || path[path_length - 1]) {
+        return Z_BAD_STRING;
+    }
+
+    char journal[PATH_MAX];
+    if (!z_journal_path(database_file, Z_JOURNAL_SUFFIX, journal, sizeof(journal))) {
+        return Z_FILE_LENGTH_TOO_LARGE;
     }
 
-    fclose(file);
+    memset(&record, 0, sizeof(record));
+    record.visited = (int64_t)time(NULL);
+    record.path_length = (uint32_t)path_length;
+    memcpy(record.path, path, path_length);
+    return z_journal_write(journal, &record);
+}
 
-    db->count = number_of_entries;
-    return Z_SUCCESS;
+/* z_journal_apply
+ * Merge one visit into the database as if z_visit had been called when it happened.
+ */
+void z_journal_apply(z_Journal_Record* restrict record, z_Database* restrict db, Arena* restrict arena)
+{
+    time_t visited = (time_t)record->visited;
+    for (size_t i = 0; i < db->count; ++i) {
+        z_Directory* dir = db->dirs + i;
+        if (estrcmp(dir->path, dir->path_length, record->path, record->path_length)) {
+            // an entry visited again since the hook journaled this keeps its later access time
+            time_t last_accessed = dir->last_accessed;
+            z_database_bump(dir, db);
+            dir->last_accessed = visited > last_accessed ? visited : last_accessed;
+            return;
+        }
+    }
+
+    if (z_write_entry_new(record->path, record->path_length, db, arena) == Z_SUCCESS) {
+        db->dirs[db->count - 1].last_accessed = visited;
+    }
 }
 
-enum z_Result z_write_entry_new(char* restrict path, size_t path_length, z_Database* restrict db, Arena* restrict arena)
+void z_journal_replay(z_Database* restrict db, Arena* restrict arena)
 {
-    assert(path && db && path_length > 1);
-    assert(path[path_length - 1] == '\0');
-    if (db->count == Z_DATABASE_IN_MEMORY_LIMIT) {
-        return Z_FAILURE;
+    char journal[PATH_MAX];
+    char replay[PATH_MAX];
+    if (!z_journal_path(db->database_file, Z_JOURNAL_SUFFIX, journal, sizeof(journal)) ||
+        !z_journal_path(db->database_file, Z_JOURNAL_REPLAY_SUFFIX, replay, sizeof(replay))) {
+        return;
     }
 
-    db->dirs[db->count].path = arena_malloc(arena, path_length, char);
+    // linked rather than renamed so a replay file which is still there is never replaced
+    if (!link(journal, replay)) {
+        unlink(journal);
+    }
 
-    memcpy(db->dirs[db->count].path, path, path_length);
-    assert(db->dirs[db->count].path[path_length - 1] == '\0');
+    int fd = open(replay, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
 
-    db->dirs[db->count].path_length = path_length;
-    ++db->dirs[db->count].rank;
-    db->dirs[db->count].last_accessed = time(NULL);
-    ++db->count;
+    // the lock is held until z_exit removes the replay file, so no hook appends to it after it has been read. It is
+    // left for the next load while a hook is still appending, and a process which gets it after z_exit has a removed
+    // file open
+    struct stat opened;
+    struct stat current;
+    if ((flock(fd, LOCK_EX | LOCK_NB) == -1 && errno == EWOULDBLOCK) || fstat(fd, &opened) == -1 ||
+        stat(replay, &current) == -1 || opened.st_dev != current.st_dev || opened.st_ino != current.st_ino) {
+        close(fd);
+        return;
+    }
 
-    return Z_SUCCESS;
+    z_Journal_Record record;
+    while (read(fd, &record, sizeof(record)) == sizeof(record)) {
+        if (record.path_length < 2 || record.path_length > sizeof(record.path) ||
+            record.path[record.path_length - 1]) {
+            continue;
+        }
+        z_journal_apply(&record, db, arena);
+    }
+
+    db->replay_fd = fd;
+    db->replayed = true;
+    db->dirty = true;
+}
+
+/* z_read_level
+ * Read as much of the database file as level asks for, merging any journaled visits when the entries are read.
+ */
+enum z_Result z_read_level(z_Database* restrict db, Arena* restrict arena, enum z_Load level)
+{
+    uint64_t start = z_trace_begin();
+    enum z_Result result = z_read_file(db, arena, level);
+    z_trace_end("read", start);
+    if (result == Z_SUCCESS && (level == Z_LOAD_FULL || level == Z_LOAD_ENTRIES)) {
+        start = z_trace_begin();
+        z_journal_replay(db, arena);
+        z_trace_end("journal", start);
+    }
+    return result;
+}
+
+enum z_Result z_read(z_Database* restrict db, Arena* restrict arena)
+{
+    return z_read_level(db, arena, Z_LOAD_FULL);
 }
 
 enum z_Result z_database_add(char* restrict path, size_t path_length, char* restrict cwd, size_t cwd_length, z_Database* restrict db,
@@ -356,7 +1297,7 @@ enum z_Result z_database_add(char* restrict path, size_t path_length, char* rest
     size_t total_length = path_length + cwd_length;
     assert(total_length > 0);
 
-    db->dirs[db->count].path = arena_malloc(arena, total_length, char);
+    db->dirs[db->count].path = z_path_alloc(&db->path_pool, total_length, arena);
 
     memcpy(db->dirs[db->count].path, cwd, cwd_length);
     db->dirs[db->count].path[cwd_length - 1] = '/';
@@ -373,6 +1314,8 @@ enum z_Result z_database_add(char* restrict path, size_t path_length, char* rest
     ++db->dirs[db->count].rank;
     db->dirs[db->count].last_accessed = time(NULL);
     ++db->count;
+    ++db->generation;
+    db->dirty = true;
 
     return Z_SUCCESS;
 }
@@ -406,23 +1349,60 @@ enum z_Result z_database_file_set(Str* restrict config_file, z_Database* restric
     return Z_SUCCESS;
 }
 
-enum z_Result z_init(Str* restrict path, z_Database* restrict db, Arena* restrict arena)
+void* z_loader_thread(void* loader)
+{
+    z_Loader* l = loader;
+    l->result = z_init_level(l->path, l->db, l->arena, l->level);
+    return NULL;
+}
+
+void z_init_async(z_Loader* restrict loader, Str* restrict path, z_Database* restrict db, Arena* restrict arena,
+                  enum z_Load level)
+{
+    assert(loader && db && arena);
+
+    *loader = (z_Loader){.path = path, .db = db, .arena = arena, .level = level, .result = Z_FAILURE};
+    loader->started = !pthread_create(&loader->thread, NULL, z_loader_thread, loader);
+    if (!loader->started) {
+        z_loader_thread(loader);
+    }
+}
+
+enum z_Result z_init_wait(z_Loader* restrict loader)
+{
+    assert(loader);
+
+    if (loader->started) {
+        pthread_join(loader->thread, NULL);
+        loader->started = false;
+    }
+
+    return loader->result;
+}
+
+enum z_Result z_init_level(Str* restrict path, z_Database* restrict db, Arena* restrict arena, enum z_Load level)
 {
     assert(db);
     if (!db) {
         return Z_NULL_REFERENCE;
     }
 
+    uint64_t start = z_trace_begin();
     enum z_Result result;
-    if ((result = z_database_file_set(path, db, arena)) != Z_SUCCESS || !db->database_file) {
-        return result;
+    if ((result = z_database_file_set(path, db, arena)) == Z_SUCCESS && db->database_file) {
+        result = z_read_level(db, arena, level);
     }
+    z_trace_end("z_init", start);
+    return result;
+}
 
-    return z_read(db, arena);
+enum z_Result z_init(Str* restrict path, z_Database* restrict db, Arena* restrict arena)
+{
+    return z_init_level(path, db, arena, Z_LOAD_FULL);
 }
 
 [[nodiscard]]
-bool z_is_dir(struct dirent* restrict dir)
+bool z_is_dir(int dir_fd, struct dirent* restrict dir)
 {
 #ifdef _DIRENT_HAVE_D_TYPE
     if (dir->d_type != DT_UNKNOWN) {
@@ -431,56 +1411,187 @@ bool z_is_dir(struct dirent* restrict dir)
 #endif /* ifdef _DIRENT_HAVE_D_TYPE */
 
     struct stat sb;
-    return !stat(dir->d_name, &sb) && S_ISDIR(sb.st_mode);
+    return !fstatat(dir_fd, dir->d_name, &sb, 0) && S_ISDIR(sb.st_mode);
 }
 
-enum z_Result z_directory_match_exists(char* restrict target, size_t target_length, char* restrict cwd, Str* restrict output,
-                                       Arena* restrict scratch_arena)
+/* z_directory_listing_find
+ * Case insensitive search of the subdirectories of dir_fd for target, copying the real name into output.
+ * The listing is only read again when the directory has changed since it was cached. Directories too large for the
+ * cache are still searched, just not cached.
+ */
+enum z_Result z_directory_listing_find(int dir_fd, char* restrict target, size_t target_length, Str* restrict output,
+                                       z_Directory_Listing* restrict listing)
 {
-    assert(target && cwd && target_length > 0);
+    assert(target && output && output->value && listing);
 
-    struct dirent* dir;
-    DIR* current_dir = opendir(cwd);
+    struct stat sb;
+    if (fstat(dir_fd, &sb)) {
+        return Z_FAILURE;
+    }
+
+    bool cached = listing->valid && listing->dev == sb.st_dev && listing->ino == sb.st_ino &&
+                  listing->mtime.tv_sec == sb.st_mtim.tv_sec && listing->mtime.tv_nsec == sb.st_mtim.tv_nsec;
+    if (cached) {
+        for (size_t offset = 0; offset < listing->length;) {
+            char* name = listing->names + offset;
+            size_t name_length = strlen(name) + 1;
+            if (name_length == target_length && !strcasecmp(name, target)) {
+                memcpy(output->value, name, name_length);
+                output->length = name_length;
+                return Z_SUCCESS;
+            }
+            offset += name_length;
+        }
+        return Z_MATCH_NOT_FOUND;
+    }
+
+    // fdopendir takes ownership of the descriptor and the caller still needs dir_fd
+    int listing_fd = dup(dir_fd);
+    DIR* current_dir = listing_fd == -1 ? NULL : fdopendir(listing_fd);
     if (!current_dir) {
-        perror("z: could not open directory");
+        if (listing_fd != -1) {
+            close(listing_fd);
+        }
         return Z_FAILURE;
     }
 
-    size_t dir_len;
+    listing->valid = true;
+    listing->length = 0;
+    enum z_Result result = Z_MATCH_NOT_FOUND;
+    struct dirent* dir;
     while ((dir = readdir(current_dir))) {
-        if (!dir || !*dir->d_name) {
+        if (!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..") || !z_is_dir(dir_fd, dir)) {
             continue;
         }
 
-#ifdef _DIRENT_HAVE_D_RECLEN
-        dir_len = dir->d_reclen + 1;
-#else
-        dir_len = strlen(dir->d_name) + 1;
-#endif /* _DIRENT_HAVE_D_RECLEN */
+        size_t name_length = strlen(dir->d_name) + 1;
+        if (result != Z_SUCCESS && name_length == target_length && !strcasecmp(dir->d_name, target)) {
+            memcpy(output->value, dir->d_name, name_length);
+            output->length = name_length;
+            result = Z_SUCCESS;
+        }
+
+        if (listing->length + name_length > Z_LISTING_CACHE_SIZE) {
+            listing->valid = false;
+        }
+        if (listing->valid) {
+            memcpy(listing->names + listing->length, dir->d_name, name_length);
+            listing->length += name_length;
+        }
+    }
 
-        if (z_is_dir(dir) && estrcmp(dir->d_name, dir_len, target, target_length)) {
-            output->value = arena_malloc(scratch_arena, dir_len, char);
-            output->length = dir_len;
-            memcpy(output->value, dir->d_name, dir_len);
+    if (closedir(current_dir) == -1) {
+        listing->valid = false;
+        return Z_FAILURE;
+    }
 
-            if ((closedir(current_dir)) == -1) {
-                perror("z: could not close directory");
-                return Z_FAILURE;
-            }
+    listing->dev = sb.st_dev;
+    listing->ino = sb.st_ino;
+    listing->mtime = sb.st_mtim;
+    return result;
+}
 
-            return Z_SUCCESS;
-        }
+/* z_directory_match_exists
+ * Whether cwd has a subdirectory named target, probed directly with fstatat instead of reading the whole directory.
+ * Only direct children are considered. output->value must have room for NAME_MAX + 1 bytes.
+ * If listing isn't NULL, a subdirectory whose name only differs in case is found from a cached listing.
+ */
+enum z_Result z_directory_match_exists(char* restrict target, size_t target_length, char* restrict cwd, Str* restrict output,
+                                       z_Directory_Listing* restrict listing)
+{
+    assert(target && cwd && target_length > 0 && output && output->value);
+
+    if (target_length < 2 || target_length - 1 > NAME_MAX || memchr(target, '/', target_length - 1)) {
+        return Z_MATCH_NOT_FOUND;
+    }
+
+    int dir_fd = open(cwd, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        perror("z: could not open directory");
+        return Z_FAILURE;
+    }
+
+    enum z_Result result = Z_MATCH_NOT_FOUND;
+    struct stat sb;
+    if (!fstatat(dir_fd, target, &sb, 0) && S_ISDIR(sb.st_mode)) {
+        memcpy(output->value, target, target_length);
+        output->length = target_length;
+        result = Z_SUCCESS;
+    }
+    else if (listing) {
+        result = z_directory_listing_find(dir_fd, target, target_length, output, listing);
     }
 
-    if ((closedir(current_dir)) == -1) {
+    if (close(dir_fd) == -1) {
         perror("z: could not close directory");
         return Z_FAILURE;
     }
 
-    return Z_MATCH_NOT_FOUND;
+    return result;
+}
+
+z_Probe z_probe_new(char* restrict target, size_t target_length, char* restrict cwd, z_Directory_Listing* listing,
+                    Arena* restrict scratch_arena)
+{
+    return (z_Probe){.target = target,
+                     .target_length = target_length,
+                     .cwd = cwd,
+                     .listing = listing,
+                     .output = {.value = arena_malloc(scratch_arena, NAME_MAX + 1, char)}};
+}
+
+void* z_probe_thread(void* probe)
+{
+    z_Probe* p = probe;
+    uint64_t start = z_trace_begin();
+    p->result = z_directory_match_exists(p->target, p->target_length, p->cwd, &p->output, p->listing);
+    z_trace_end("probe", start);
+    p->done = true;
+    return NULL;
+}
+
+void z_probe(char* restrict target, size_t target_length, char* restrict cwd, z_Directory_Listing* listing,
+             z_Probe* restrict probe, Arena* restrict scratch_arena)
+{
+    assert(target && cwd && probe && scratch_arena);
+
+    *probe = z_probe_new(target, target_length, cwd, listing, scratch_arena);
+    z_probe_thread(probe);
+}
+
+/* z_chdir
+ * chdir traced on its own, it can be the slowest part of a jump on network or automounted filesystems.
+ */
+static int z_chdir(char* restrict path)
+{
+    uint64_t start = z_trace_begin();
+    int result = chdir(path);
+    z_trace_end("chdir", start);
+    return result;
+}
+
+/* z_match_change_directory
+ * Change to the matched directory and bump its rank and last accessed time, false if chdir fails.
+ */
+bool z_match_change_directory(z_Directory* match, z_Database* db)
+{
+    assert(match && match->path && db);
+
+    if (z_chdir(match->path) == -1) {
+        return false;
+    }
+
+    z_database_bump(match, db);
+    return true;
 }
 
 void z(char* restrict target, size_t target_length, char* restrict cwd, z_Database* restrict db, Arena* restrict arena, Arena scratch_arena)
+{
+    z_with_probe(target, target_length, cwd, NULL, db, arena, scratch_arena);
+}
+
+void z_with_probe(char* restrict target, size_t target_length, char* restrict cwd, z_Probe* restrict probe,
+                  z_Database* restrict db, Arena* restrict arena, Arena scratch_arena)
 {
 #ifdef Z_DEBUG
     printf("z: %s\n", target);
@@ -493,7 +1604,7 @@ void z(char* restrict target, size_t target_length, char* restrict cwd, z_Databa
 
     if (!target) {
         if (home) {
-            if (chdir(home) == -1) {
+            if (z_chdir(home) == -1) {
                 perror("z: couldn't change directory to home");
             }
         }
@@ -511,7 +1622,7 @@ void z(char* restrict target, size_t target_length, char* restrict cwd, z_Databa
     }
 
     if (estrcmp(target, target_length, home, strlen(home) + 1)) {
-        if (chdir(home) == -1) {
+        if (z_chdir(home) == -1) {
             perror("z: couldn't change directory to home");
         }
 
@@ -520,7 +1631,7 @@ void z(char* restrict target, size_t target_length, char* restrict cwd, z_Databa
 
     // handle z .
     if (target_length == 2 && target[0] == '.') {
-        if (chdir(target) == -1) {
+        if (z_chdir(target) == -1) {
             perror("z: couldn't change directory (1)");
         }
 
@@ -528,7 +1639,7 @@ void z(char* restrict target, size_t target_length, char* restrict cwd, z_Databa
     }
     // handle z ..
     else if (target_length == 3 && target[0] == '.' && target[1] == '.') {
-        if (chdir(target) == -1) {
+        if (z_chdir(target) == -1) {
             perror("z: couldn't change directory (2)");
         }
 
@@ -536,15 +1647,52 @@ void z(char* restrict target, size_t target_length, char* restrict cwd, z_Databa
     }
 
     size_t cwd_length = strlen(cwd) + 1;
-    Str output = {0};
-    z_Directory* match = z_match_find(target, target_length, cwd, cwd_length, db, &scratch_arena);
+    z_Probe local_probe;
+    if (!probe || !probe->done) {
+        local_probe = z_probe_new(target, target_length, cwd, NULL, &scratch_arena);
+        probe = &local_probe;
+    }
+    assert(estrcmp(probe->target, probe->target_length, target, target_length) && !strcmp(probe->cwd, cwd));
+
+    time_t now = time(NULL);
+    uint64_t start = z_trace_begin();
+    uint64_t key = z_query_cache_key(target, target_length, cwd, cwd_length);
+    z_Directory* match = z_query_cache_find(key, db, now);
+    z_trace_end("cache", start);
+    pthread_t probe_thread;
+    bool probe_started = false;
+    if (!match) {
+        // probe the cwd for target on another thread while matching against the database, small databases are
+        // scored before the thread would have started
+        probe_started = !probe->done && db->count >= Z_PARALLEL_THRESHOLD &&
+                        !pthread_create(&probe_thread, NULL, z_probe_thread, probe);
+
+        z_Match ranked = z_match_find_ranked(target, target_length, cwd, cwd_length, db, &scratch_arena);
+        match = ranked.dir;
+        if (match) {
+            z_query_cache_store(key, &ranked, db, now);
+        }
+    }
+
+    if (probe_started) {
+        pthread_join(probe_thread, NULL);
+    }
+    else if (!probe->done) {
+        z_probe_thread(probe);
+    }
+    // listing the cwd only pays off when there is nowhere else to go
+    if (Z_CASE_INSENSITIVE_FALLBACK && probe->result != Z_SUCCESS && !match) {
+        probe->listing = &db->listing;
+        z_probe_thread(probe);
+    }
 
-    if (z_directory_match_exists(target, target_length, cwd, &output, &scratch_arena) == Z_SUCCESS) {
+    Str output = probe->output;
+    if (probe->result == Z_SUCCESS) {
 #ifdef Z_DEBUG
         printf("dir matches %s\n", output.value);
 #endif /* ifdef Z_DEBUG */
 
-        if (chdir(output.value) == -1) {
+        if (z_chdir(output.value) == -1) {
             if (!match) {
                 perror("z: couldn't change directory (3)");
                 return;
@@ -559,21 +1707,17 @@ void z(char* restrict target, size_t target_length, char* restrict cwd, z_Databa
 
     if (match && match->path) {
         // try to change to the match first, if that doesn't work try target
-        if (chdir(match->path) == -1) {
-            if (chdir(target) == -1) {
+        if (!z_match_change_directory(match, db)) {
+            if (z_chdir(target) == -1) {
                 perror("z: couldn't change directory (4)");
                 return;
             }
             z_database_add(target, target_length, cwd, cwd_length, db, arena);
-            return;
         }
-
-        match->last_accessed = time(NULL);
-        ++match->rank;
         return;
     }
 
-    if (chdir(target) == -1) {
+    if (z_chdir(target) == -1) {
         perror("z: couldn't change directory");
         return;
     }
@@ -581,6 +1725,132 @@ void z(char* restrict target, size_t target_length, char* restrict cwd, z_Databa
     z_database_add(target, target_length, cwd, cwd_length, db, arena);
 }
 
+void z_keywords(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count, char* restrict cwd,
+                z_Database* restrict db, Arena* restrict arena, Arena scratch_arena)
+{
+    assert(keywords && keyword_lengths && cwd && db && arena && scratch_arena.start);
+    if (!keywords || !keyword_lengths || !keywords_count || !cwd || !db) {
+        return;
+    }
+
+    if (keywords_count == 1) {
+        z(*keywords, *keyword_lengths, cwd, db, arena, scratch_arena);
+        return;
+    }
+
+    for (size_t i = 0; i < keywords_count; ++i) {
+        if (!keywords[i] || keyword_lengths[i] < 2 || keywords[i][keyword_lengths[i] - 1]) {
+            return;
+        }
+    }
+
+    z_Directory* match =
+        z_keywords_match_find(keywords, keyword_lengths, keywords_count, cwd, strlen(cwd) + 1, db, &scratch_arena);
+    if (!match) {
+        fputs("z: no match found.\n", stderr);
+        return;
+    }
+
+    if (!z_match_change_directory(match, db)) {
+        perror("z: couldn't change directory");
+    }
+}
+
+z_Directory* z_query_keywords(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                              char* restrict cwd, z_Database* restrict db, Arena scratch_arena)
+{
+    assert(keywords && keyword_lengths && keywords_count && cwd && db);
+
+    if (keywords_count == 1) {
+        return z_query(*keywords, *keyword_lengths, cwd, db, scratch_arena);
+    }
+    return z_keywords_match_find(keywords, keyword_lengths, keywords_count, cwd, strlen(cwd) + 1, db, &scratch_arena);
+}
+
+/* z_resolve_output
+ * Copy path into output, Z_BAD_STRING if it doesn't fit.
+ */
+enum z_Result z_resolve_output(char* restrict path, size_t path_length, Str* restrict output)
+{
+    if (path_length > output->length) {
+        return Z_BAD_STRING;
+    }
+
+    memcpy(output->value, path, path_length);
+    output->length = path_length;
+    return Z_SUCCESS;
+}
+
+bool z_is_directory(char* restrict path)
+{
+    struct stat sb;
+    return !stat(path, &sb) && S_ISDIR(sb.st_mode);
+}
+
+enum z_Result z_resolve(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                        char* restrict cwd, z_Database* restrict db, Arena* restrict arena, Arena scratch_arena,
+                        Str* restrict output)
+{
+    assert(cwd && db && arena && output && output->value);
+
+    char* home = getenv("HOME");
+    if (!keywords_count) {
+        return home ? z_resolve_output(home, strlen(home) + 1, output) : Z_NULL_REFERENCE;
+    }
+
+    assert(keywords && keyword_lengths);
+    for (size_t i = 0; i < keywords_count; ++i) {
+        if (!keywords[i] || keyword_lengths[i] < 2 || keywords[i][keyword_lengths[i] - 1]) {
+            return Z_BAD_STRING;
+        }
+    }
+
+    size_t cwd_length = strlen(cwd) + 1;
+    if (keywords_count > 1) {
+        z_Directory* match =
+            z_keywords_match_find(keywords, keyword_lengths, keywords_count, cwd, cwd_length, db, &scratch_arena);
+        if (!match) {
+            return Z_MATCH_NOT_FOUND;
+        }
+        z_database_bump(match, db);
+        return z_resolve_output(match->path, match->path_length, output);
+    }
+
+    char* target = *keywords;
+    size_t target_length = *keyword_lengths;
+    char path[PATH_MAX];
+    // z doesn't record home, . or .. either
+    if ((home && estrcmp(target, target_length, home, strlen(home) + 1)) || estrcmp(target, target_length, ".", 2) ||
+        estrcmp(target, target_length, "..", 3)) {
+        return realpath(target, path) ? z_resolve_output(path, strlen(path) + 1, output) : Z_FILE_ERROR;
+    }
+
+    z_Directory* match = z_query(target, target_length, cwd, db, scratch_arena);
+    if (match && z_is_directory(match->path)) {
+        z_database_bump(match, db);
+        return z_resolve_output(match->path, match->path_length, output);
+    }
+
+    z_Probe probe;
+    z_probe(target, target_length, cwd, Z_CASE_INSENSITIVE_FALLBACK ? &db->listing : NULL, &probe, &scratch_arena);
+    if (probe.result == Z_SUCCESS) {
+        int length = snprintf(path, sizeof(path), "%s/%s", cwd, probe.output.value);
+        if (length < 0 || (size_t)length >= sizeof(path)) {
+            return Z_BAD_STRING;
+        }
+        z_database_add(probe.output.value, probe.output.length, cwd, cwd_length, db, arena);
+        return z_resolve_output(path, (size_t)length + 1, output);
+    }
+
+    if (realpath(target, path) && z_is_directory(path)) {
+        size_t path_length = strlen(path) + 1;
+        z_visit(path, path_length, db, arena);
+        return z_resolve_output(path, path_length, output);
+    }
+
+    return Z_MATCH_NOT_FOUND;
+}
+
 #define Z_ENTRY_EXISTS_MESSAGE "z: Entry already exists in z database.\n"
 #define Z_ADDED_NEW_ENTRY_MESSAGE "z: Added new entry to z database.\n"
 #define Z_ERROR_ADDING_ENTRY_MESSAGE "z: Error adding new entry to z database.\n"
@@ -617,6 +1887,23 @@ enum z_Result z_add(char* restrict path, size_t path_length, z_Database* restric
     return Z_CANNOT_PROCESS;
 }
 
+enum z_Result z_visit(char* restrict path, size_t path_length, z_Database* restrict db, Arena* restrict arena)
+{
+    assert(db && arena);
+    if (!path) {
+        return Z_NULL_REFERENCE;
+    }
+    if (path_length < 2 || path[path_length - 1] != '\0') {
+        return Z_BAD_STRING;
+    }
+
+    if (z_match_exists(path, path_length, db)) {
+        return Z_SUCCESS;
+    }
+
+    return z_write_entry_new(path, path_length, db, arena);
+}
+
 void z_remove_dirs_shift(size_t offset, z_Database* restrict db)
 {
     if (offset + 1 == db->count) {
@@ -628,6 +1915,29 @@ void z_remove_dirs_shift(size_t offset, z_Database* restrict db)
     }
 }
 
+enum z_Result z_database_remove(char* restrict path, size_t path_length, z_Database* restrict db)
+{
+    assert(db && path && path_length);
+
+    for (size_t i = 0; i < db->count; ++i) {
+        if (estrcmp((db->dirs + i)->path, (db->dirs + i)->path_length, (char*)path, path_length)) {
+            z_path_free(&db->path_pool, (db->dirs + i)->path, (db->dirs + i)->path_length);
+            (db->dirs + i)->path = NULL;
+            (db->dirs + i)->path_length = 0;
+            (db->dirs + i)->last_accessed = 0;
+            (db->dirs + i)->rank = 0;
+            z_remove_dirs_shift(i, db);
+            --db->count;
+            ++db->generation;
+            db->dirty = true;
+            db->basename_index.count = 0;
+            return Z_SUCCESS;
+        }
+    }
+
+    return Z_MATCH_NOT_FOUND;
+}
+
 #define Z_ENTRY_NOT_FOUND_MESSAGE "z: Entry could not be found in z database.\n"
 #define Z_ENTRY_REMOVED_MESSAGE "z: Removed entry from z database.\n"
 enum z_Result z_remove(char* restrict path, size_t path_length, z_Database* restrict db)
@@ -643,19 +1953,11 @@ enum z_Result z_remove(char* restrict path, size_t path_length, z_Database* rest
         return Z_BAD_STRING;
     }
 
-    for (size_t i = 0; i < db->count; ++i) {
-        if (estrcmp((db->dirs + i)->path, (db->dirs + i)->path_length, (char*)path, path_length)) {
-            (db->dirs + i)->path = NULL;
-            (db->dirs + i)->path_length = 0;
-            (db->dirs + i)->last_accessed = 0;
-            (db->dirs + i)->rank = 0;
-            z_remove_dirs_shift(i, db);
-            --db->count;
-            if (write(STDOUT_FILENO, Z_ENTRY_REMOVED_MESSAGE, sizeof(Z_ENTRY_REMOVED_MESSAGE) - 1) == -1) {
-                return Z_FAILURE;
-            }
-            return Z_SUCCESS;
+    if (z_database_remove(path, path_length, db) == Z_SUCCESS) {
+        if (write(STDOUT_FILENO, Z_ENTRY_REMOVED_MESSAGE, sizeof(Z_ENTRY_REMOVED_MESSAGE) - 1) == -1) {
+            return Z_FAILURE;
         }
+        return Z_SUCCESS;
     }
 
     if (write(STDOUT_FILENO, Z_ENTRY_NOT_FOUND_MESSAGE, sizeof(Z_ENTRY_NOT_FOUND_MESSAGE) - 1) == -1) {
@@ -664,21 +1966,57 @@ enum z_Result z_remove(char* restrict path, size_t path_length, z_Database* rest
     return Z_MATCH_NOT_FOUND;
 }
 
+/* z_journal_requeue
+ * Move records appended to the replay file since it was merged back into the journal for the next load, a writer
+ * which opened the journal before it was moved aside and didn't take the lock can still add them.
+ */
+void z_journal_requeue(z_Database* restrict db)
+{
+    char journal[PATH_MAX];
+    if (!z_journal_path(db->database_file, Z_JOURNAL_SUFFIX, journal, sizeof(journal))) {
+        return;
+    }
+
+    z_Journal_Record record;
+    while (read(db->replay_fd, &record, sizeof(record)) == sizeof(record)) {
+        z_journal_write(journal, &record);
+    }
+}
+
 enum z_Result z_exit(z_Database* restrict db)
 {
     assert(db);
     if (!db) {
         return Z_NULL_REFERENCE;
     }
+    if (!db->dirty) {
+        return Z_SUCCESS;
+    }
+    // writing without the entries would lose them, the query cache is fine to lose
+    if (db->loaded == Z_LOAD_HEADER || db->loaded == Z_LOAD_NONE) {
+        return Z_CANNOT_PROCESS;
+    }
 
-    enum z_Result result;
-    if ((result = z_write(db)) != Z_SUCCESS) {
+    uint64_t start = z_trace_begin();
+    enum z_Result result = z_write(db);
+    z_trace_end("write", start);
+    if (result != Z_SUCCESS) {
         if (write(STDOUT_FILENO, Z_ERROR_WRITING_TO_DB_MESSAGE, sizeof(Z_ERROR_WRITING_TO_DB_MESSAGE) - 1) == -1) {
             return result;
         }
         return result;
     }
 
+    db->dirty = false;
+    if (db->replayed) {
+        z_journal_requeue(db);
+        char replay[PATH_MAX];
+        if (z_journal_path(db->database_file, Z_JOURNAL_REPLAY_SUFFIX, replay, sizeof(replay))) {
+            unlink(replay);
+        }
+        close(db->replay_fd);
+        db->replayed = false;
+    }
     return Z_SUCCESS;
 }
 
@@ -7,13 +7,55 @@
 #ifndef Z_H_
 #define Z_H_
 
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <time.h>
 
 #include "arena.h"
 #include "str.h"
 
 #define Z_DATABASE_FILE "_z_database.bin"
+#ifndef Z_DATABASE_IN_MEMORY_LIMIT
 #define Z_DATABASE_IN_MEMORY_LIMIT 200
+#endif /* !Z_DATABASE_IN_MEMORY_LIMIT */
+
+// databases with at least this many entries are scored by a pool of Z_PARALLEL_WORKERS threads
+#ifndef Z_PARALLEL_THRESHOLD
+#define Z_PARALLEL_THRESHOLD 4096
+#endif /* !Z_PARALLEL_THRESHOLD */
+#ifndef Z_PARALLEL_WORKERS
+#define Z_PARALLEL_WORKERS 4
+#endif /* !Z_PARALLEL_WORKERS */
+// scratch each worker needs on top of its entries for its slab and scoring a candidate, when the scratch arena can't
+// give every worker that much the database is scored on fewer workers
+#ifndef Z_MATCH_WORKER_SCRATCH
+#define Z_MATCH_WORKER_SCRATCH (1 << 12)
+#endif /* !Z_MATCH_WORKER_SCRATCH */
+// scratch split between the workers on top of what their entries need, growable scratch arenas make room for it
+// before splitting
+#ifndef Z_MATCH_SCRATCH_SIZE
+#define Z_MATCH_SCRATCH_SIZE (1 << 20)
+#endif /* !Z_MATCH_SCRATCH_SIZE */
+
+// basenames are indexed under each of their first Z_BASENAME_PREFIX_MAX characters for prefix lookups
+#ifndef Z_BASENAME_PREFIX_MAX
+#define Z_BASENAME_PREFIX_MAX 8
+#endif /* !Z_BASENAME_PREFIX_MAX */
+#define Z_BASENAME_BUCKETS (Z_DATABASE_IN_MEMORY_LIMIT * 4)
+// added to the z_score of fuzzy matches which fall entirely within the last path component, 0 to disable
+#ifndef Z_BASENAME_BONUS
+#define Z_BASENAME_BONUS 0
+#endif /* !Z_BASENAME_BONUS */
+
+// when neither the database nor a child of the cwd named exactly like the target match, look for a child differing
+// only in case. Off by default, it reads the whole cwd
+#ifndef Z_CASE_INSENSITIVE_FALLBACK
+#define Z_CASE_INSENSITIVE_FALLBACK 0
+#endif /* !Z_CASE_INSENSITIVE_FALLBACK */
+#ifndef Z_LISTING_CACHE_SIZE
+#define Z_LISTING_CACHE_SIZE 8192
+#endif /* !Z_LISTING_CACHE_SIZE */
 
 #define Z_SECOND 1
 #define Z_MINUTE 60 * Z_SECOND
@@ -22,6 +64,11 @@
 #define Z_WEEK 7 * Z_DAY
 #define Z_MONTH 30 * Z_DAY
 
+// seconds for the frecency weight of an entry to decay halfway to its floor, see z_frecency_weight
+#ifndef Z_FRECENCY_HALF_LIFE
+#define Z_FRECENCY_HALF_LIFE (Z_DAY)
+#endif /* !Z_FRECENCY_HALF_LIFE */
+
 typedef struct {
     double rank;
     time_t last_accessed;
@@ -31,13 +78,107 @@ typedef struct {
 
 typedef struct {
     double z_score;
+    double runner_up; // upper bound on the z_score of the best non winning entry, 0 if nothing else matched
     z_Directory* dir;
 } z_Match;
 
+#ifndef Z_QUERY_CACHE_SLOTS
+#define Z_QUERY_CACHE_SLOTS 16
+#endif /* !Z_QUERY_CACHE_SLOTS */
+
+/* z_Query_Cache_Slot
+ * A cached z_match_find result for one (pattern, cwd) pair, stored after the entries in the database file.
+ * The answer holds while the database generation is unchanged and the winners frecency hasn't decayed by more than
+ * margin, the winning z_score minus the runner up. Other entries only lose frecency over time, so the winner can't
+ * be overtaken until one of those happens.
+ */
+typedef struct {
+    uint64_t key;
+    uint64_t generation;
+    uint32_t entry; // index in dirs + 1, 0 is empty
+    double frecency;
+    double margin;
+} z_Query_Cache_Slot;
+
+// visits recorded by z hook are appended to the database file name plus this suffix and merged on the next load
+#define Z_JOURNAL_SUFFIX ".journal"
+// while being merged the journal is moved to this, so visits recorded in the meantime start a new journal
+#define Z_JOURNAL_REPLAY_SUFFIX ".journal.replay"
+#define Z_JOURNAL_RECORD_SIZE 512
+
+/* z_Journal_Record
+ * One visit in the journal. Records are a fixed size and written with a single write to a file opened with O_APPEND,
+ * so concurrent hooks can't interleave partial records.
+ */
+typedef struct {
+    int64_t visited;
+    uint32_t path_length;
+    char path[Z_JOURNAL_RECORD_SIZE - sizeof(int64_t) - sizeof(uint32_t)];
+} z_Journal_Record;
+
+/* z_Basename_Index
+ * Hash chains from the lowercased prefixes of each entries last path component to its index in dirs.
+ * Node n belongs to entry n / Z_BASENAME_PREFIX_MAX and covers the first n % Z_BASENAME_PREFIX_MAX + 1 characters.
+ * Buckets and next store node + 1 so a zeroed index is empty.
+ */
 typedef struct {
-    // bool dirty;
+    size_t count; // entries indexed so far, entries past this are indexed lazily
+    uint32_t buckets[Z_BASENAME_BUCKETS];
+    uint32_t next[Z_DATABASE_IN_MEMORY_LIMIT * Z_BASENAME_PREFIX_MAX];
+} z_Basename_Index;
+
+/* z_Directory_Listing
+ * The subdirectory names of the last directory searched case insensitively, reused until its mtime changes.
+ */
+typedef struct {
+    bool valid;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    size_t length;
+    char names[Z_LISTING_CACHE_SIZE]; // null separated
+} z_Directory_Listing;
+
+#define Z_PATH_CLASS_MIN 16
+#define Z_PATH_CLASS_MAX 4096
+#define Z_PATH_CLASSES 17
+
+/* z_Path_Pool
+ * Path memory given back by removed entries, reused for the paths of new ones instead of taking more of the arena.
+ * Paths are allocated in size classes going 16, 24, 32, 48, 64... up to Z_PATH_CLASS_MAX with a free list for each.
+ * A block on a free list holds the pointer to the next one. Paths longer than that are never reused.
+ */
+typedef struct z_Path_Block {
+    struct z_Path_Block* next;
+} z_Path_Block;
+
+typedef struct {
+    z_Path_Block* free[Z_PATH_CLASSES];
+} z_Path_Pool;
+
+/* z_Load
+ * How much of the database file z_init_level reads, commands only pay for what they use.
+ * A zeroed database counts as fully loaded.
+ */
+enum z_Load {
+    Z_LOAD_FULL,    // entries and query cache
+    Z_LOAD_ENTRIES, // the entries without the query cache, for commands which don't query
+    Z_LOAD_HEADER,  // only the number of entries, for z count
+    Z_LOAD_NONE     // nothing, for commands resolved without the database like z, z . and z ..
+};
+
+typedef struct {
+    bool dirty;    // changed since it was read, z_exit only writes dirty databases
+    bool replayed; // merged a journal which z_exit removes once the database file is written
+    int replay_fd; // the merged journal, locked while replayed so no other process merges it too
+    enum z_Load loaded;
     size_t count;
     char* database_file;
+    uint64_t generation; // incremented whenever an answer in query_cache could change
+    z_Query_Cache_Slot query_cache[Z_QUERY_CACHE_SLOTS];
+    z_Basename_Index basename_index;
+    z_Directory_Listing listing;
+    z_Path_Pool path_pool;
     z_Directory dirs[Z_DATABASE_IN_MEMORY_LIMIT];
 } z_Database;
 
@@ -58,13 +199,121 @@ enum z_Result {
 
 enum z_Result z_init(Str* restrict path, z_Database* restrict db, Arena* restrict arena);
 
+/* z_init_level
+ * z_init which only reads as much of the database file as level asks for.
+ */
+enum z_Result z_init_level(Str* restrict path, z_Database* restrict db, Arena* restrict arena, enum z_Load level);
+
+typedef struct {
+    pthread_t thread;
+    bool started;
+    Str* path;
+    z_Database* db;
+    Arena* arena;
+    enum z_Load level;
+    enum z_Result result;
+} z_Loader;
+
+/* z_init_async
+ * Start z_init on a helper thread so the caller can do other work, like z_probe, while the database loads.
+ * Falls back to loading synchronously if the thread can't be started. Nothing may touch db or arena until
+ * z_init_wait returns.
+ */
+void z_init_async(z_Loader* restrict loader, Str* restrict path, z_Database* restrict db, Arena* restrict arena,
+                  enum z_Load level);
+
+/* z_init_wait
+ * Wait for the load started by z_init_async and return what z_init returned.
+ */
+enum z_Result z_init_wait(z_Loader* restrict loader);
+
+/* z_Probe
+ * Whether cwd has a subdirectory named target, see z_probe.
+ */
+typedef struct {
+    char* target;
+    size_t target_length;
+    char* cwd;
+    z_Directory_Listing* listing;
+    Str output;
+    enum z_Result result;
+    bool done;
+} z_Probe;
+
+/* z_probe
+ * Check cwd for a subdirectory named target ahead of z, for example while the database is still loading.
+ * listing can be NULL to skip the case insensitive fallback. Pass the probe to z_with_probe, which falls back on its
+ * own when the database has no match either.
+ */
+void z_probe(char* restrict target, size_t target_length, char* restrict cwd, z_Directory_Listing* listing,
+             z_Probe* restrict probe, Arena* restrict scratch_arena);
+
 void z(char* restrict target, size_t target_length, char* restrict cwd, z_Database* restrict db, Arena* restrict arena,
        Arena scratch_arena);
 
+/* z_with_probe
+ * z using the result of an earlier z_probe for the same target and cwd instead of probing again.
+ */
+void z_with_probe(char* restrict target, size_t target_length, char* restrict cwd, z_Probe* restrict probe,
+                  z_Database* restrict db, Arena* restrict arena, Arena scratch_arena);
+
+/* z_keywords
+ * z with multiple keywords, `z proj api` changes to the best match containing proj followed by api in its last
+ * component. A single keyword is the same as z.
+ */
+void z_keywords(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count, char* restrict cwd,
+                z_Database* restrict db, Arena* restrict arena, Arena scratch_arena);
+
+/* z_query
+ * The best match for target from cwd without changing directory or bumping it, NULL if nothing matches.
+ */
+z_Directory* z_query(char* restrict target, size_t target_length, char* restrict cwd, z_Database* restrict db,
+                     Arena scratch_arena);
+
+/* z_query_keywords
+ * z_query for one or more keywords, several keywords match the way z_keywords does.
+ */
+z_Directory* z_query_keywords(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                              char* restrict cwd, z_Database* restrict db, Arena scratch_arena);
+
+/* z_journal_append
+ * Record a visit to path in the journal next to database_file without reading the database, for prompt hooks.
+ * Z_BAD_STRING if path is too long for a journal record, use z_visit instead.
+ */
+enum z_Result z_journal_append(char* restrict database_file, char* restrict path, size_t path_length);
+
+/* z_journal_replay
+ * Merge the visits recorded by z hook since the database file was last written. The journal is moved aside first so
+ * hooks running meanwhile start a new one, and a replay file left by a process which exited before writing the
+ * database is merged instead of being replaced. A replay file another process is merging is skipped.
+ */
+void z_journal_replay(z_Database* restrict db, Arena* restrict arena);
+
+/* z_resolve
+ * Where z or z_keywords would change to, written to output instead of changing directory. The visit is recorded the
+ * same way. output's length is the capacity of its buffer on the way in and the length of the path on the way out.
+ * Z_MATCH_NOT_FOUND if there is nowhere to go.
+ */
+enum z_Result z_resolve(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                        char* restrict cwd, z_Database* restrict db, Arena* restrict arena, Arena scratch_arena,
+                        Str* restrict output);
+
 enum z_Result z_add(char* restrict path, size_t path_length, z_Database* restrict db, Arena* restrict arena);
 
+/* z_visit
+ * Record a visit to path, bumping it if it is already in the database and adding it otherwise. Unlike z_add it
+ * doesn't write any messages.
+ */
+enum z_Result z_visit(char* restrict path, size_t path_length, z_Database* restrict db, Arena* restrict arena);
+
 enum z_Result z_remove(char* restrict path, size_t path_length, z_Database* restrict db);
 
+/* z_database_remove
+ * z_remove without writing any messages, Z_MATCH_NOT_FOUND if path isn't in the database.
+ * The entrys path goes back to db->path_pool, so the path stored in the database is no longer valid.
+ */
+enum z_Result z_database_remove(char* restrict path, size_t path_length, z_Database* restrict db);
+
 enum z_Result z_exit(z_Database* restrict db);
 
 void z_print(z_Database* restrict db);
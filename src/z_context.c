@@ -0,0 +1,114 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* This project is licensed under GNU GPLv3 */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "z_context.h"
+#include "z_trace.h"
+
+struct z_Context {
+    Arena arena;
+    Arena scratch_arena;
+    z_Database db;
+};
+
+z_Context* z_context_new(Str* restrict location)
+{
+    assert(location);
+
+    z_trace_init();
+    z_Context* context = calloc(1, sizeof(z_Context));
+    if (!context) {
+        return NULL;
+    }
+
+    // reserved arenas never move, fall back to chaining blocks where the address space can't be reserved
+    if (!arena_reserve_new(&context->arena, Z_CONTEXT_ARENA_RESERVE) &&
+        !arena_chain_new(&context->arena, Z_CONTEXT_ARENA_SIZE)) {
+        free(context);
+        return NULL;
+    }
+    if (!arena_reserve_new(&context->scratch_arena, Z_CONTEXT_SCRATCH_RESERVE) &&
+        !arena_chain_new(&context->scratch_arena, Z_CONTEXT_SCRATCH_SIZE)) {
+        arena_free(&context->arena);
+        free(context);
+        return NULL;
+    }
+
+    arena_stats_name(&context->arena, "z_context arena");
+    arena_stats_name(&context->scratch_arena, "z_context scratch");
+
+    if (z_init(location, &context->db, &context->arena) != Z_SUCCESS) {
+        arena_free(&context->arena);
+        arena_free(&context->scratch_arena);
+        free(context);
+        return NULL;
+    }
+
+    return context;
+}
+
+void z_context_jump(z_Context* restrict context, char* restrict target, size_t target_length, char* restrict cwd)
+{
+    assert(context);
+
+    z(target, target_length, cwd, &context->db, &context->arena, context->scratch_arena);
+}
+
+enum z_Result z_context_query(z_Context* restrict context, char** restrict keywords, size_t* restrict keyword_lengths,
+                              size_t keywords_count, char* restrict cwd, Str* restrict output)
+{
+    assert(context);
+
+    return z_resolve(keywords, keyword_lengths, keywords_count, cwd, &context->db, &context->arena,
+                     context->scratch_arena, output);
+}
+
+enum z_Result z_context_visit(z_Context* restrict context, char* restrict path, size_t path_length)
+{
+    assert(context);
+
+    return z_visit(path, path_length, &context->db, &context->arena);
+}
+
+enum z_Result z_context_remove(z_Context* restrict context, char* restrict path, size_t path_length)
+{
+    assert(context);
+    if (!path || path_length < 2 || path[path_length - 1]) {
+        return Z_BAD_STRING;
+    }
+
+    return z_database_remove(path, path_length, &context->db);
+}
+
+z_Database* z_context_database(z_Context* restrict context)
+{
+    assert(context);
+
+    return &context->db;
+}
+
+enum z_Result z_context_flush(z_Context* restrict context)
+{
+    assert(context);
+
+    arena_reset(&context->scratch_arena);
+    enum z_Result result = z_exit(&context->db);
+    z_trace_flush();
+    return result;
+}
+
+enum z_Result z_context_free(z_Context* restrict context)
+{
+    if (!context) {
+        return Z_NULL_REFERENCE;
+    }
+
+    enum z_Result result = z_exit(&context->db);
+    arena_free(&context->arena);
+    arena_free(&context->scratch_arena);
+    free(context);
+    return result;
+}
@@ -0,0 +1,74 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* z_context: the z API for programs embedding z, like a shell, built as libz with 'make lib' */
+/* This project is licensed under GNU GPLv3 */
+
+#pragma once
+#ifndef Z_CONTEXT_H_
+#define Z_CONTEXT_H_
+
+#include <stddef.h>
+
+#include "str.h"
+#include "z.h"
+
+// address space reserved for the arenas, only the pages used are committed
+#ifndef Z_CONTEXT_ARENA_RESERVE
+#define Z_CONTEXT_ARENA_RESERVE (1UL << 30)
+#endif /* !Z_CONTEXT_ARENA_RESERVE */
+#ifndef Z_CONTEXT_SCRATCH_RESERVE
+#define Z_CONTEXT_SCRATCH_RESERVE (1UL << 28)
+#endif /* !Z_CONTEXT_SCRATCH_RESERVE */
+// where the address space can't be reserved the arenas start with blocks of these sizes and grow as needed
+#ifndef Z_CONTEXT_ARENA_SIZE
+#define Z_CONTEXT_ARENA_SIZE (1 << 16)
+#endif /* !Z_CONTEXT_ARENA_SIZE */
+#ifndef Z_CONTEXT_SCRATCH_SIZE
+#define Z_CONTEXT_SCRATCH_SIZE (1 << 20)
+#endif /* !Z_CONTEXT_SCRATCH_SIZE */
+
+/* z_Context
+ * Owns the database, its indexes and the arenas they live in. Load it once and keep it for the life of the program,
+ * every call after that works on the database in memory. Not thread safe, use one context per thread.
+ */
+typedef struct z_Context z_Context;
+
+/* z_context_new
+ * Load the database file in the directory location, which must end with a slash. NULL if that fails.
+ */
+z_Context* z_context_new(Str* restrict location);
+
+/* z_context_jump
+ * z, changing the calling process to the best match for target from cwd.
+ */
+void z_context_jump(z_Context* restrict context, char* restrict target, size_t target_length, char* restrict cwd);
+
+/* z_context_query
+ * z_resolve, writing where z would change to for keywords from cwd into output.
+ */
+enum z_Result z_context_query(z_Context* restrict context, char** restrict keywords, size_t* restrict keyword_lengths,
+                              size_t keywords_count, char* restrict cwd, Str* restrict output);
+
+/* z_context_visit
+ * Record a visit to path, for example from a shell's cd builtin.
+ */
+enum z_Result z_context_visit(z_Context* restrict context, char* restrict path, size_t path_length);
+
+enum z_Result z_context_remove(z_Context* restrict context, char* restrict path, size_t path_length);
+
+/* z_context_database
+ * The database owned by context, for z_print, z_count and anything else in z.h.
+ */
+z_Database* z_context_database(z_Context* restrict context);
+
+/* z_context_flush
+ * Write the database file if anything changed since it was loaded or last flushed, and give back the scratch pages
+ * used since then. Spans recorded with Z_TRACE set are written here too.
+ */
+enum z_Result z_context_flush(z_Context* restrict context);
+
+/* z_context_free
+ * Flush the database and free everything the context owns.
+ */
+enum z_Result z_context_free(z_Context* restrict context);
+
+#endif // !Z_CONTEXT_H_
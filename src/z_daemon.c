@@ -0,0 +1,518 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* This project is licensed under GNU GPLv3 */
+
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // for sigaction and SOCK_CLOEXEC
+#endif                  /* ifndef _DEFAULT_SOURCE */
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "z_platform.h" // used for macros
+#include "z_daemon.h"
+#include "z_trace.h"
+
+// once the arena has less than this left the daemon reloads the database into a fresh one after flushing
+#define Z_DAEMON_ARENA_RESERVE (PATH_MAX * 16)
+
+Str z_daemon_socket_path(char* restrict buffer, size_t buffer_length)
+{
+    assert(buffer && buffer_length);
+
+    char* runtime_directory = getenv("XDG_RUNTIME_DIR");
+    int length;
+    if (runtime_directory && *runtime_directory) {
+        length = snprintf(buffer, buffer_length, "%s/" Z_DAEMON_SOCKET, runtime_directory);
+    }
+    else {
+        length = snprintf(buffer, buffer_length, "/tmp/z-%u/" Z_DAEMON_SOCKET, (unsigned)getuid());
+    }
+
+    if (length < 0 || (size_t)length >= buffer_length) {
+        return Str_Empty;
+    }
+    return Str_New(buffer, (size_t)length + 1);
+}
+
+/* z_daemon_address
+ * The socket address of the daemon, false if the socket path is too long for sun_path.
+ */
+bool z_daemon_address(struct sockaddr_un* restrict address)
+{
+    *address = (struct sockaddr_un){.sun_family = AF_UNIX};
+    return z_daemon_socket_path(address->sun_path, sizeof(address->sun_path)).value;
+}
+
+/* z_daemon_private
+ * Whether the directory holding the socket at path belongs to the current user and nobody else can get into it, so
+ * another user can't stand in for the daemon. create makes the directory first if it doesn't exist.
+ */
+bool z_daemon_private(char* restrict path, bool create)
+{
+    char directory[PATH_MAX];
+    char* slash = strrchr(path, '/');
+    if (!slash || slash == path || (size_t)(slash - path) >= sizeof(directory)) {
+        return false;
+    }
+    memcpy(directory, path, (size_t)(slash - path));
+    directory[slash - path] = '\0';
+
+    if (create && mkdir(directory, 0700) == -1 && errno != EEXIST) {
+        return false;
+    }
+
+    struct stat sb;
+    return !lstat(directory, &sb) && S_ISDIR(sb.st_mode) && sb.st_uid == getuid() && !(sb.st_mode & 077);
+}
+
+/* z_daemon_timeout_set
+ * Stop reads and writes on fd from blocking for longer than Z_DAEMON_TIMEOUT.
+ */
+void z_daemon_timeout_set(int fd)
+{
+    struct timeval timeout = {.tv_sec = Z_DAEMON_TIMEOUT / 1000, .tv_usec = (Z_DAEMON_TIMEOUT % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+int z_daemon_connect(void)
+{
+    struct sockaddr_un address;
+    if (!z_daemon_address(&address) || !z_daemon_private(address.sun_path, false)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    z_daemon_timeout_set(fd);
+    return fd;
+}
+
+/* z_daemon_read
+ * Read exactly length bytes, Z_ZERO_BYTES_READ if the other side hung up before sending anything.
+ */
+enum z_Result z_daemon_read(int fd, void* restrict buffer, size_t length)
+{
+    size_t total = 0;
+    while (total < length) {
+        ssize_t bytes_read = read(fd, (char*)buffer + total, length - total);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            return !bytes_read && !total ? Z_ZERO_BYTES_READ : Z_FILE_ERROR;
+        }
+        total += (size_t)bytes_read;
+    }
+
+    return Z_SUCCESS;
+}
+
+/* z_daemon_write
+ * Write all of the buffers in a single call where the socket allows it.
+ */
+enum z_Result z_daemon_write(int fd, struct iovec* restrict buffers, int count)
+{
+    while (count) {
+        ssize_t bytes_written = writev(fd, buffers, count);
+        if (bytes_written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_written <= 0) {
+            return Z_FILE_ERROR;
+        }
+
+        size_t remaining = (size_t)bytes_written;
+        while (count && remaining >= buffers->iov_len) {
+            remaining -= buffers->iov_len;
+            ++buffers;
+            --count;
+        }
+        if (count) {
+            buffers->iov_base = (char*)buffers->iov_base + remaining;
+            buffers->iov_len -= remaining;
+        }
+    }
+
+    return Z_SUCCESS;
+}
+
+enum z_Result z_daemon_request(int fd, enum z_Daemon_Op op, char* restrict target, size_t target_length,
+                               char* restrict cwd, size_t cwd_length, Str* restrict output)
+{
+    assert(fd >= 0 && target && target_length);
+    if (target_length > PATH_MAX || cwd_length > PATH_MAX) {
+        return Z_BAD_STRING;
+    }
+
+    z_Daemon_Request request = {.op = op, .target_length = (uint32_t)target_length, .cwd_length = (uint32_t)cwd_length};
+    struct iovec buffers[] = {{.iov_base = &request, .iov_len = sizeof(request)},
+                              {.iov_base = target, .iov_len = target_length},
+                              {.iov_base = cwd, .iov_len = cwd_length}};
+    if (z_daemon_write(fd, buffers, cwd_length ? 3 : 2) != Z_SUCCESS) {
+        return Z_FILE_ERROR;
+    }
+
+    z_Daemon_Response response;
+    if (z_daemon_read(fd, &response, sizeof(response)) != Z_SUCCESS) {
+        return Z_FILE_ERROR;
+    }
+
+    if (response.length) {
+        if (!output || response.length > output->length) {
+            return Z_FILE_ERROR;
+        }
+        if (z_daemon_read(fd, output->value, response.length) != Z_SUCCESS) {
+            return Z_FILE_ERROR;
+        }
+    }
+    if (output) {
+        output->length = response.length;
+    }
+
+    return (enum z_Result)response.result;
+}
+
+/* z_daemon_pack
+ * Copy keywords one after another into buffer the way Z_DAEMON_QUERY takes them.
+ * The length of the packed keywords, 0 if one of them is empty or they don't fit.
+ */
+size_t z_daemon_pack(char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                     char* restrict buffer, size_t buffer_length)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < keywords_count; ++i) {
+        if (keyword_lengths[i] < 2 || keywords[i][keyword_lengths[i] - 1] ||
+            keyword_lengths[i] > buffer_length - length) {
+            return 0;
+        }
+        memcpy(buffer + length, keywords[i], keyword_lengths[i]);
+        length += keyword_lengths[i];
+    }
+
+    return length;
+}
+
+enum z_Result z_daemon_resolve(int fd, char** restrict keywords, size_t* restrict keyword_lengths,
+                               size_t keywords_count, char* restrict cwd, Arena scratch_arena, Str* restrict output)
+{
+    assert(keywords && keyword_lengths && keywords_count && cwd && output && output->value);
+
+    char packed[PATH_MAX];
+    size_t packed_length = z_daemon_pack(keywords, keyword_lengths, keywords_count, packed, sizeof(packed));
+    if (!packed_length) {
+        return Z_BAD_STRING;
+    }
+
+    size_t capacity = output->length;
+    enum z_Result result = z_daemon_request(fd, Z_DAEMON_QUERY, packed, packed_length, cwd, strlen(cwd) + 1, output);
+    struct stat sb;
+    if (result == Z_SUCCESS && output->length && !output->value[output->length - 1] && !stat(output->value, &sb) &&
+        S_ISDIR(sb.st_mode)) {
+        return z_daemon_request(fd, Z_DAEMON_ADD, output->value, output->length, NULL, 0, NULL);
+    }
+    if (result != Z_SUCCESS && result != Z_MATCH_NOT_FOUND) {
+        return result;
+    }
+    // like z_keywords, several keywords only match the database
+    if (keywords_count > 1) {
+        return Z_MATCH_NOT_FOUND;
+    }
+
+    // not in the database, or no longer there, so like z try a subdirectory of cwd and then target itself
+    char* target = *keywords;
+    size_t target_length = *keyword_lengths;
+    char path[PATH_MAX];
+    z_Probe probe;
+    z_probe(target, target_length, cwd, NULL, &probe, &scratch_arena);
+    if (probe.result == Z_SUCCESS) {
+        int length = snprintf(path, sizeof(path), "%s/%s", cwd, probe.output.value);
+        if (length < 0 || (size_t)length >= sizeof(path)) {
+            return Z_BAD_STRING;
+        }
+    }
+    else if (!realpath(target, path) || stat(path, &sb) || !S_ISDIR(sb.st_mode)) {
+        return Z_MATCH_NOT_FOUND;
+    }
+
+    size_t path_length = strlen(path) + 1;
+    if (path_length > capacity) {
+        return Z_BAD_STRING;
+    }
+    memcpy(output->value, path, path_length);
+    output->length = path_length;
+    return z_daemon_request(fd, Z_DAEMON_ADD, path, path_length, NULL, 0, NULL);
+}
+
+enum z_Result z_daemon_jump(int fd, char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                            char* restrict cwd, Arena scratch_arena)
+{
+    char path[PATH_MAX];
+    Str output = Str_New(path, sizeof(path));
+    enum z_Result result = z_daemon_resolve(fd, keywords, keyword_lengths, keywords_count, cwd, scratch_arena, &output);
+    if (result != Z_SUCCESS) {
+        return result;
+    }
+
+    if (chdir(output.value) == -1) {
+        perror("z: couldn't change directory");
+        return Z_FAILURE;
+    }
+    return Z_SUCCESS;
+}
+
+/* z_daemon_respond
+ * Send result and output, which can be NULL, to the client.
+ */
+enum z_Result z_daemon_respond(int fd, enum z_Result result, char* restrict output, size_t output_length)
+{
+    z_Daemon_Response response = {.result = result, .length = output ? (uint32_t)output_length : 0};
+    struct iovec buffers[] = {{.iov_base = &response, .iov_len = sizeof(response)},
+                              {.iov_base = output, .iov_len = response.length}};
+    return z_daemon_write(fd, buffers, response.length ? 2 : 1);
+}
+
+/* z_daemon_query
+ * Unpack the keywords in target and find their best match, NULL if nothing matches or one of them is empty.
+ */
+z_Directory* z_daemon_query(char* restrict target, size_t target_length, char* restrict cwd, z_Database* restrict db,
+                            Arena scratch_arena)
+{
+    size_t keywords_count = 0;
+    for (size_t i = 0; i < target_length; ++i) {
+        keywords_count += !target[i];
+    }
+
+    char** keywords = arena_malloc(&scratch_arena, keywords_count, char*);
+    size_t* keyword_lengths = arena_malloc(&scratch_arena, keywords_count, size_t);
+    char* keyword = target;
+    for (size_t i = 0; i < keywords_count; ++i) {
+        keywords[i] = keyword;
+        keyword_lengths[i] = strlen(keyword) + 1;
+        if (keyword_lengths[i] < 2) {
+            return NULL;
+        }
+        keyword += keyword_lengths[i];
+    }
+
+    return z_query_keywords(keywords, keyword_lengths, keywords_count, cwd, db, scratch_arena);
+}
+
+enum z_Result z_daemon_serve(int fd, z_Database* restrict db, Arena* restrict arena, Arena scratch_arena)
+{
+    assert(fd >= 0 && db && arena);
+
+    char target[PATH_MAX];
+    char cwd[PATH_MAX];
+    z_Daemon_Request request;
+    enum z_Result result;
+    while ((result = z_daemon_read(fd, &request, sizeof(request))) == Z_SUCCESS) {
+        if (request.target_length < 2 || request.target_length > PATH_MAX || request.cwd_length > PATH_MAX) {
+            return Z_BAD_STRING;
+        }
+        if ((result = z_daemon_read(fd, target, request.target_length)) != Z_SUCCESS ||
+            (request.cwd_length && (result = z_daemon_read(fd, cwd, request.cwd_length)) != Z_SUCCESS)) {
+            return Z_FILE_ERROR;
+        }
+        if (target[request.target_length - 1] || (request.cwd_length && cwd[request.cwd_length - 1])) {
+            return Z_BAD_STRING;
+        }
+
+        z_Directory* match = NULL;
+        switch (request.op) {
+        case Z_DAEMON_QUERY: {
+            if (request.cwd_length < 2) {
+                result = Z_BAD_STRING;
+                break;
+            }
+            match = z_daemon_query(target, request.target_length, cwd, db, scratch_arena);
+            result = match ? Z_SUCCESS : Z_MATCH_NOT_FOUND;
+            break;
+        }
+        case Z_DAEMON_ADD: {
+            result = z_visit(target, request.target_length, db, arena);
+            break;
+        }
+        case Z_DAEMON_REMOVE: {
+            result = z_database_remove(target, request.target_length, db);
+            break;
+        }
+        default: {
+            result = Z_CANNOT_PROCESS;
+            break;
+        }
+        }
+
+        if (z_daemon_respond(fd, result, match ? match->path : NULL, match ? match->path_length : 0) != Z_SUCCESS) {
+            return Z_FILE_ERROR;
+        }
+        // the daemon never exits between requests, so each one gets its own line
+        z_trace_flush();
+    }
+
+    return result == Z_ZERO_BYTES_READ ? Z_SUCCESS : result;
+}
+
+static volatile sig_atomic_t z_daemon_stopping;
+
+static void z_daemon_stop(int signum)
+{
+    (void)signum;
+    z_daemon_stopping = 1;
+}
+
+/* z_daemon_listen
+ * Bind the daemon's socket, replacing one left behind by a daemon which didn't shut down cleanly.
+ * Only the current user can connect to it.
+ */
+int z_daemon_listen(struct sockaddr_un* restrict address)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("z: couldn't create daemon socket");
+        return -1;
+    }
+
+    unlink(address->sun_path);
+    mode_t mask = umask(0177);
+    int bound = bind(fd, (struct sockaddr*)address, sizeof(*address));
+    umask(mask);
+    if (bound == -1 || listen(fd, SOMAXCONN) == -1) {
+        perror("z: couldn't listen on daemon socket");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* z_daemon_flush
+ * Merge visits journaled by hooks which couldn't reach the daemon and write the database file, the write would
+ * overwrite them otherwise. Then reload it into a fresh arena if paths added since starting have used most of it.
+ * Only fixed arenas need this, growable ones chain another block.
+ */
+enum z_Result z_daemon_flush(Str* restrict location, z_Database* restrict db, Arena* restrict arena, Arena base)
+{
+    z_journal_replay(db, arena);
+    enum z_Result result = z_exit(db);
+    if (result != Z_SUCCESS || arena->block || arena->end - arena->start >= Z_DAEMON_ARENA_RESERVE) {
+        return result;
+    }
+
+    memset(db, 0, sizeof(*db));
+    *arena = base;
+    return z_init(location, db, arena);
+}
+
+#define Z_DAEMON_RUNNING_MESSAGE "z: daemon is already running.\n"
+
+enum z_Result z_daemon_run(Str* restrict location, z_Database* restrict db, Arena* restrict arena,
+                           Arena scratch_arena)
+{
+    assert(location && db && arena);
+
+    struct sockaddr_un address;
+    if (!z_daemon_address(&address)) {
+        fputs("z: daemon socket path is too long.\n", stderr);
+        return Z_BAD_STRING;
+    }
+    if (!z_daemon_private(address.sun_path, true)) {
+        fprintf(stderr, "z: daemon socket directory for %s must belong to you and nobody else.\n", address.sun_path);
+        return Z_FILE_ERROR;
+    }
+
+    int fd = z_daemon_connect();
+    if (fd != -1) {
+        close(fd);
+        fputs(Z_DAEMON_RUNNING_MESSAGE, stderr);
+        return Z_FAILURE;
+    }
+
+    Arena base = *arena;
+    enum z_Result result = z_init(location, db, arena);
+    if (result != Z_SUCCESS) {
+        return result;
+    }
+
+    int listener = z_daemon_listen(&address);
+    if (listener == -1) {
+        return Z_FILE_ERROR;
+    }
+
+    struct sigaction stop = {.sa_handler = z_daemon_stop};
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // changes are batched, the first one after a flush starts the countdown to the next. A clean database still wakes
+    // up every interval to merge visits journaled by hooks which couldn't reach the daemon
+    time_t dirty_since = 0;
+    while (!z_daemon_stopping) {
+        int timeout = Z_DAEMON_FLUSH_INTERVAL * 1000;
+        if (db->dirty) {
+            time_t elapsed = time(NULL) - dirty_since;
+            timeout = elapsed >= Z_DAEMON_FLUSH_INTERVAL ? 0 : (int)(Z_DAEMON_FLUSH_INTERVAL - elapsed) * 1000;
+        }
+
+        struct pollfd listening = {.fd = listener, .events = POLLIN};
+        int ready = poll(&listening, 1, timeout);
+        if (ready == -1 && errno != EINTR) {
+            perror("z: daemon couldn't wait for clients");
+            result = Z_FILE_ERROR;
+            break;
+        }
+
+        if (!ready && !db->dirty) {
+            z_journal_replay(db, arena);
+            dirty_since = 0;
+        }
+        else if (ready > 0) {
+            int client = accept(listener, NULL, NULL);
+            if (client != -1) {
+                bool was_dirty = db->dirty;
+                z_daemon_timeout_set(client);
+                z_daemon_serve(client, db, arena, scratch_arena);
+                close(client);
+                if (!was_dirty && db->dirty) {
+                    dirty_since = time(NULL);
+                }
+            }
+        }
+
+        if (db->dirty && time(NULL) - dirty_since >= Z_DAEMON_FLUSH_INTERVAL) {
+            if ((result = z_daemon_flush(location, db, arena, base)) != Z_SUCCESS) {
+                break;
+            }
+            // give back the pages busy clients used since the last flush
+            arena_trim(&scratch_arena);
+        }
+    }
+
+    close(listener);
+    unlink(address.sun_path);
+
+    z_journal_replay(db, arena);
+    enum z_Result exit_result = z_exit(db);
+    return result != Z_SUCCESS ? result : exit_result;
+}
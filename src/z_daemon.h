@@ -0,0 +1,94 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* z_daemon: keeps the z database in memory and serves it to z clients over a Unix domain socket */
+/* This project is licensed under GNU GPLv3 */
+
+#pragma once
+#ifndef Z_DAEMON_H_
+#define Z_DAEMON_H_
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "str.h"
+#include "z.h"
+
+// the socket lives in XDG_RUNTIME_DIR, or in /tmp/z-<uid> when it isn't set. Clients only trust sockets in a directory
+// which the current user owns and nobody else can access
+#define Z_DAEMON_SOCKET "z.sock"
+// seconds changes are held in memory before being written to the database file
+#ifndef Z_DAEMON_FLUSH_INTERVAL
+#define Z_DAEMON_FLUSH_INTERVAL 30
+#endif /* !Z_DAEMON_FLUSH_INTERVAL */
+// milliseconds a client or the daemon waits on the other side before giving up
+#ifndef Z_DAEMON_TIMEOUT
+#define Z_DAEMON_TIMEOUT 250
+#endif /* !Z_DAEMON_TIMEOUT */
+
+enum z_Daemon_Op {
+    Z_DAEMON_QUERY = 1, // target is one or more keywords and cwd, responds with the path of the best match
+    Z_DAEMON_ADD = 2,   // target is a path, bumped if it exists and added otherwise
+    Z_DAEMON_REMOVE = 3 // target is a path
+};
+
+/* z_Daemon_Request
+ * Sent by the client followed by target_length bytes of target and cwd_length bytes of cwd, both null terminated.
+ * Keywords are sent one after another in target, each with its own null terminator.
+ */
+typedef struct {
+    uint32_t op;
+    uint32_t target_length;
+    uint32_t cwd_length;
+} z_Daemon_Request;
+
+/* z_Daemon_Response
+ * Sent by the daemon followed by length bytes of output. result is an enum z_Result.
+ */
+typedef struct {
+    int32_t result;
+    uint32_t length;
+} z_Daemon_Response;
+
+/* z_daemon_socket_path
+ * The path of the daemon's socket, length includes the null terminator. Str_Empty if it doesn't fit in buffer.
+ */
+Str z_daemon_socket_path(char* restrict buffer, size_t buffer_length);
+
+/* z_daemon_connect
+ * Connect to a running daemon, -1 if there isn't one.
+ */
+int z_daemon_connect(void);
+
+/* z_daemon_request
+ * Send a request over fd and wait for the response. output can be NULL for ops which don't respond with anything,
+ * otherwise its length is the capacity of its buffer and is set to the length of the output.
+ * Z_FILE_ERROR means the daemon couldn't be talked to and the caller should fall back to the database file.
+ */
+enum z_Result z_daemon_request(int fd, enum z_Daemon_Op op, char* restrict target, size_t target_length,
+                               char* restrict cwd, size_t cwd_length, Str* restrict output);
+
+/* z_daemon_resolve
+ * z_resolve for clients of the daemon, output works the same way.
+ */
+enum z_Result z_daemon_resolve(int fd, char** restrict keywords, size_t* restrict keyword_lengths,
+                               size_t keywords_count, char* restrict cwd, Arena scratch_arena, Str* restrict output);
+
+/* z_daemon_jump
+ * z and z_keywords for clients of the daemon: change to the best match for keywords, or to a single keyword itself,
+ * and record the visit.
+ */
+enum z_Result z_daemon_jump(int fd, char** restrict keywords, size_t* restrict keyword_lengths, size_t keywords_count,
+                            char* restrict cwd, Arena scratch_arena);
+
+/* z_daemon_serve
+ * Answer requests from the client on fd until it disconnects.
+ */
+enum z_Result z_daemon_serve(int fd, z_Database* restrict db, Arena* restrict arena, Arena scratch_arena);
+
+/* z_daemon_run
+ * Load the database from location and serve it until SIGINT or SIGTERM, writing changes back to the database file
+ * at most every Z_DAEMON_FLUSH_INTERVAL seconds and once more on the way out.
+ */
+enum z_Result z_daemon_run(Str* restrict location, z_Database* restrict db, Arena* restrict arena,
+                           Arena scratch_arena);
+
+#endif // !Z_DAEMON_H_
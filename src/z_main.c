@@ -9,7 +9,10 @@
 #include "ecolors.h"
 #include "str.h"
 #include "z.h"
+#include "z_daemon.h"
 #include "help.h"
+#include "z_shell.h"
+#include "z_trace.h"
 #include "arena.h"
 #include "z_platform.h" // used for macros
 
@@ -20,9 +23,81 @@
 #define Z_PRINT "print"
 #define Z_COUNT "count"
 #define Z_HELP "help"
+#define Z_DAEMON "daemon" // keep the database in memory and serve it to other z processes
+#define Z_QUERY "query"   // print where z would change to, used by the shell integration
+#define Z_HOOK "hook"     // record a visit, used by the shell integration's cd hook
+#define Z_INIT "init"     // print the shell integration
+#define Z_STATS "stats"   // print how much of the arenas a query uses, needs a build with ARENA_STATS
 
 int z_(z_Database* restrict z_db, char** restrict buffer, size_t* restrict buf_lens, Arena* arena, Arena* restrict scratch);
 
+bool z_is_command(char* restrict arg, size_t arg_length);
+
+#define Z_QUERY_NOT_FOUND_MESSAGE "z: no match found.\n"
+
+/* z_query_print
+ * Print the path z_resolve found on its own line.
+ */
+int z_query_print(enum z_Result result, Str* restrict output)
+{
+    if (result != Z_SUCCESS) {
+        fputs(Z_QUERY_NOT_FOUND_MESSAGE, stderr);
+        return EXIT_FAILURE;
+    }
+
+    output->value[output->length - 1] = '\n';
+    if (write(STDOUT_FILENO, output->value, output->length) == -1) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int z_query_(z_Database* restrict z_db, char** restrict keywords, size_t* restrict keyword_lengths,
+             size_t keywords_count, Arena* restrict arena, Arena scratch)
+{
+    char cwd[PATH_MAX] = {0};
+    if (!getcwd(cwd, PATH_MAX)) {
+        perror(RED "z: Could not load cwd information" RESET);
+        return EXIT_FAILURE;
+    }
+
+    char path[PATH_MAX];
+    Str output = Str_New(path, sizeof(path));
+    enum z_Result result = z_resolve(keywords, keyword_lengths, keywords_count, cwd, z_db, arena, scratch, &output);
+    return z_query_print(result, &output);
+}
+
+/* z_is_hook_path
+ * Whether the hook should record path, like z it skips home and only takes absolute paths.
+ */
+bool z_is_hook_path(char* restrict path, size_t path_length)
+{
+    char* home = getenv("HOME");
+    return path_length > 1 && *path == '/' && !(home && estrcmp(path, path_length, home, strlen(home) + 1));
+}
+
+/* z_stats_
+ * Resolve keywords like z query without printing the match, then report the arena stats of this run to stdout.
+ */
+int z_stats_(z_Database* restrict z_db, char** restrict keywords, size_t* restrict keyword_lengths,
+             size_t keywords_count, Arena* restrict arena, Arena scratch)
+{
+    if (keywords_count) {
+        char cwd[PATH_MAX] = {0};
+        if (!getcwd(cwd, PATH_MAX)) {
+            perror(RED "z: Could not load cwd information" RESET);
+            return EXIT_FAILURE;
+        }
+
+        char path[PATH_MAX];
+        Str output = Str_New(path, sizeof(path));
+        z_resolve(keywords, keyword_lengths, keywords_count, cwd, z_db, arena, scratch, &output);
+    }
+
+    arena_stats_report(stdout);
+    return EXIT_SUCCESS;
+}
+
 #define Z_COMMAND_NOT_FOUND_MESSAGE "ncsh z: command not found, options not supported.\n"
 
 [[nodiscard]]
@@ -42,6 +117,23 @@ int z_(z_Database* restrict z_db, char** restrict buffer, size_t* restrict buf_l
     // skip first position since we know it is 'z'
     char** arg = buffer + 1;
     size_t* arg_lens = buf_lens + 1;
+
+    // z query ...
+    if (estrcmp(*arg, *arg_lens, Z_QUERY, sizeof(Z_QUERY))) {
+        size_t keywords_count = 0;
+        while (arg[keywords_count + 1] && arg_lens[keywords_count + 1]) {
+            ++keywords_count;
+        }
+        return z_query_(z_db, arg + 1, arg_lens + 1, keywords_count, arena, *scratch);
+    }
+    // z stats ...
+    if (estrcmp(*arg, *arg_lens, Z_STATS, sizeof(Z_STATS))) {
+        size_t keywords_count = 0;
+        while (arg[keywords_count + 1] && arg_lens[keywords_count + 1]) {
+            ++keywords_count;
+        }
+        return z_stats_(z_db, arg + 1, arg_lens + 1, keywords_count, arena, *scratch);
+    }
     if (arg_lens[1] == 0) {
         assert(arg && *arg);
 
@@ -55,6 +147,10 @@ int z_(z_Database* restrict z_db, char** restrict buffer, size_t* restrict buf_l
             z_count(z_db);
             return EXIT_SUCCESS;
         }
+        // z help
+        if (estrcmp(*arg, *arg_lens, Z_HELP, sizeof(Z_HELP))) {
+            return z_help() ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
 
         // z
         char cwd[PATH_MAX] = {0};
@@ -88,6 +184,14 @@ int z_(z_Database* restrict z_db, char** restrict buffer, size_t* restrict buf_l
 
             return EXIT_SUCCESS;
         }
+        // z hook
+        else if (estrcmp(*arg, *arg_lens, Z_HOOK, sizeof(Z_HOOK))) {
+            assert(arg[1] && arg_lens[1]);
+            if (!z_is_hook_path(arg[1], arg_lens[1])) {
+                return EXIT_SUCCESS;
+            }
+            return z_visit(arg[1], arg_lens[1], z_db, arena) == Z_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
         else if (estrcmp(*arg, *arg_lens, Z_HELP, sizeof(Z_HELP))) {
             assert(arg[1] && arg_lens[1]);
             if (z_help()) {
@@ -98,33 +202,345 @@ int z_(z_Database* restrict z_db, char** restrict buffer, size_t* restrict buf_l
         }
     }
 
+    // z foo bar ...
+    if (!z_is_command(*arg, *arg_lens)) {
+        size_t keywords_count = 0;
+        while (arg[keywords_count] && arg_lens[keywords_count]) {
+            ++keywords_count;
+        }
+
+        char cwd[PATH_MAX] = {0};
+        if (!getcwd(cwd, PATH_MAX)) {
+            perror(RED "ncsh z: Could not load cwd information" RESET);
+            return EXIT_FAILURE;
+        }
+
+        z_keywords(arg, arg_lens, keywords_count, cwd, z_db, arena, *scratch);
+        return EXIT_SUCCESS;
+    }
+
     if (write(STDOUT_FILENO, Z_COMMAND_NOT_FOUND_MESSAGE, sizeof(Z_COMMAND_NOT_FOUND_MESSAGE) - 1) == -1) {
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
 }
 
-[[nodiscard("Must free returned memory to cleanup arena resources")]]
-char* a_new(Arena* a)
+// the arenas start small and grow with the database
+#define Z_ARENA_SIZE (1 << 16)
+#define Z_SCRATCH_SIZE (1 << 16)
+// address space the daemon reserves for its arenas, only the pages it uses are committed
+#define Z_DAEMON_ARENA_SIZE (1UL << 30)
+#define Z_DAEMON_SCRATCH_SIZE (1UL << 28)
+
+/* z_arenas_new
+ * The daemon lives as long as the session so it reserves its arenas up front, they never move and their RSS tracks
+ * what they hold. Everything else, or the daemon if the address space can't be reserved, chains small blocks.
+ */
+[[nodiscard]]
+bool z_arenas_new(Arena* restrict arena, Arena* restrict scratch, bool daemon)
+{
+    if (daemon && arena_reserve_new(arena, Z_DAEMON_ARENA_SIZE) && arena_reserve_new(scratch, Z_DAEMON_SCRATCH_SIZE)) {
+        return true;
+    }
+    arena_free(arena);
+
+    if (!arena_chain_new(arena, Z_ARENA_SIZE) || !arena_chain_new(scratch, Z_SCRATCH_SIZE)) {
+        arena_free(arena);
+        return false;
+    }
+    return true;
+}
+
+#define Z_DATA "Z_DATA" // directory the database file lives in, defaults to HOME
+
+/* z_database_location
+ * The directory containing the database file with a trailing slash, length includes the null terminator.
+ */
+Str z_database_location(char* restrict buffer, size_t buffer_length)
 {
-    char* memory;
-    arena_new(*a, 1 << 12, memory);
-    return memory;
+    char* directory = getenv(Z_DATA);
+    if (!directory || !*directory) {
+        directory = getenv("HOME");
+    }
+    if (!directory || !*directory) {
+        directory = ".";
+    }
+
+    int length = snprintf(buffer, buffer_length, "%s/", directory);
+    if (length < 0 || (size_t)length >= buffer_length) {
+        return Str_Empty;
+    }
+    return Str_New(buffer, (size_t)length + 1);
 }
 
-int main()
+bool z_is_command(char* restrict arg, size_t arg_length)
 {
-    z_Database db = {0};
-    Arena a;
-    char* memory = a_new(&a);
-    z_init(&Str_New_Literal("./"), &db, &a);
-    Str v = Str_New_Literal("/home/user/src/tests/z_tests.c");
-    z_add(v.value, v.length, &db, &a);
+    return estrcmp(arg, arg_length, Z_ADD, sizeof(Z_ADD)) || estrcmp(arg, arg_length, Z_RM, sizeof(Z_RM)) ||
+           estrcmp(arg, arg_length, Z_REMOVE, sizeof(Z_REMOVE)) ||
+           estrcmp(arg, arg_length, Z_PRINT, sizeof(Z_PRINT)) || estrcmp(arg, arg_length, Z_COUNT, sizeof(Z_COUNT)) ||
+           estrcmp(arg, arg_length, Z_HELP, sizeof(Z_HELP)) || estrcmp(arg, arg_length, Z_DAEMON, sizeof(Z_DAEMON)) ||
+           estrcmp(arg, arg_length, Z_QUERY, sizeof(Z_QUERY)) || estrcmp(arg, arg_length, Z_HOOK, sizeof(Z_HOOK)) ||
+           estrcmp(arg, arg_length, Z_INIT, sizeof(Z_INIT)) || estrcmp(arg, arg_length, Z_STATS, sizeof(Z_STATS));
+}
 
-    z_print(&db);
+/* z_load_level
+ * How much of the database a command needs, commands resolved without it don't read the database file at all.
+ */
+enum z_Load z_load_level(int argc, char** restrict argv, size_t* restrict arg_lens)
+{
+    // z changes to HOME
+    if (argc < 2) {
+        return Z_LOAD_NONE;
+    }
 
-    z_exit(&db);
-    free(memory);
+    char* arg = argv[1];
+    size_t arg_length = arg_lens[1];
+    // the daemon loads the database itself
+    if (estrcmp(arg, arg_length, Z_HELP, sizeof(Z_HELP)) || estrcmp(arg, arg_length, Z_DAEMON, sizeof(Z_DAEMON)) ||
+        estrcmp(arg, arg_length, Z_INIT, sizeof(Z_INIT))) {
+        return Z_LOAD_NONE;
+    }
 
-    return EXIT_SUCCESS;
+    // z query resolves the same targets as z
+    bool query = estrcmp(arg, arg_length, Z_QUERY, sizeof(Z_QUERY));
+    if (query) {
+        if (argc == 2) {
+            return Z_LOAD_NONE;
+        }
+        if (argc == 3) {
+            arg = argv[2];
+            arg_length = arg_lens[2];
+        }
+    }
+
+    if (argc == 2 || (query && argc == 3)) {
+        char* home = getenv("HOME");
+        if (estrcmp(arg, arg_length, ".", sizeof(".")) || estrcmp(arg, arg_length, "..", sizeof("..")) ||
+            (home && estrcmp(arg, arg_length, home, strlen(home) + 1))) {
+            return Z_LOAD_NONE;
+        }
+        if (estrcmp(arg, arg_length, Z_COUNT, sizeof(Z_COUNT))) {
+            return Z_LOAD_HEADER;
+        }
+        if (estrcmp(arg, arg_length, Z_PRINT, sizeof(Z_PRINT))) {
+            return Z_LOAD_ENTRIES;
+        }
+    }
+    else if (argc == 3 &&
+             (estrcmp(arg, arg_length, Z_ADD, sizeof(Z_ADD)) || estrcmp(arg, arg_length, Z_RM, sizeof(Z_RM)) ||
+              estrcmp(arg, arg_length, Z_REMOVE, sizeof(Z_REMOVE)) ||
+              estrcmp(arg, arg_length, Z_HOOK, sizeof(Z_HOOK)))) {
+        // adding, removing and visiting invalidates every cached query anyway
+        return Z_LOAD_ENTRIES;
+    }
+
+    return Z_LOAD_FULL;
+}
+
+#define Z_DAEMON_ADDED_MESSAGE "z: Added entry to z database.\n"
+#define Z_DAEMON_REMOVED_MESSAGE "z: Removed entry from z database.\n"
+#define Z_DAEMON_NOT_FOUND_MESSAGE "z: Entry could not be found in z database.\n"
+
+/* z_daemon_
+ * Handle a jump, query, hook, add or remove through a running daemon. Z_FILE_ERROR if the daemon couldn't be used,
+ * in which case nothing was changed and the caller should use the database file instead.
+ */
+enum z_Result z_daemon_(int fd, int argc, char** restrict argv, size_t* restrict arg_lens, Arena scratch)
+{
+    if (!z_is_command(argv[1], arg_lens[1])) {
+        char cwd[PATH_MAX] = {0};
+        if (!getcwd(cwd, PATH_MAX)) {
+            perror(RED "z: Could not load cwd information" RESET);
+            return Z_FAILURE;
+        }
+        return z_daemon_jump(fd, argv + 1, arg_lens + 1, (size_t)argc - 1, cwd, scratch);
+    }
+
+    if (estrcmp(argv[1], arg_lens[1], Z_QUERY, sizeof(Z_QUERY))) {
+        char cwd[PATH_MAX] = {0};
+        if (!getcwd(cwd, PATH_MAX)) {
+            perror(RED "z: Could not load cwd information" RESET);
+            return Z_FAILURE;
+        }
+
+        char path[PATH_MAX];
+        Str output = Str_New(path, sizeof(path));
+        enum z_Result result = z_daemon_resolve(fd, argv + 2, arg_lens + 2, (size_t)argc - 2, cwd, scratch, &output);
+        if (result == Z_FILE_ERROR) {
+            return result;
+        }
+        return z_query_print(result, &output) == EXIT_SUCCESS ? Z_SUCCESS : Z_FAILURE;
+    }
+
+    assert(argc == 3);
+    if (arg_lens[2] < 2) {
+        return Z_BAD_STRING;
+    }
+    if (estrcmp(argv[1], arg_lens[1], Z_HOOK, sizeof(Z_HOOK))) {
+        if (!z_is_hook_path(argv[2], arg_lens[2])) {
+            return Z_SUCCESS;
+        }
+        return z_daemon_request(fd, Z_DAEMON_ADD, argv[2], arg_lens[2], NULL, 0, NULL);
+    }
+
+    enum z_Daemon_Op op = estrcmp(argv[1], arg_lens[1], Z_ADD, sizeof(Z_ADD)) ? Z_DAEMON_ADD : Z_DAEMON_REMOVE;
+    enum z_Result result = z_daemon_request(fd, op, argv[2], arg_lens[2], NULL, 0, NULL);
+    char* message = NULL;
+    if (result == Z_SUCCESS) {
+        message = op == Z_DAEMON_ADD ? Z_DAEMON_ADDED_MESSAGE : Z_DAEMON_REMOVED_MESSAGE;
+    }
+    else if (result == Z_MATCH_NOT_FOUND) {
+        message = Z_DAEMON_NOT_FOUND_MESSAGE;
+    }
+    if (message && write(STDOUT_FILENO, message, strlen(message)) == -1) {
+        return Z_FAILURE;
+    }
+
+    return result;
+}
+
+/* z_hook_
+ * z hook runs on every cd so it skips everything it can, no arenas and no reading the database, just a request to
+ * the daemon or one record appended to the journal. Z_BAD_STRING if the visit has to be recorded the slow way.
+ */
+enum z_Result z_hook_(char* restrict path)
+{
+    size_t path_length = strlen(path) + 1;
+    if (!z_is_hook_path(path, path_length)) {
+        return Z_SUCCESS;
+    }
+
+    int fd = z_daemon_connect();
+    if (fd != -1) {
+        enum z_Result result = z_daemon_request(fd, Z_DAEMON_ADD, path, path_length, NULL, 0, NULL);
+        close(fd);
+        if (result != Z_FILE_ERROR) {
+            return result;
+        }
+    }
+
+    char location_buffer[PATH_MAX];
+    Str location = z_database_location(location_buffer, sizeof(location_buffer));
+    if (!location.value) {
+        return Z_BAD_STRING;
+    }
+
+    char database_file[PATH_MAX];
+    int length = snprintf(database_file, sizeof(database_file), "%s" Z_DATABASE_FILE, location.value);
+    if (length < 0 || (size_t)length >= sizeof(database_file)) {
+        return Z_BAD_STRING;
+    }
+
+    return z_journal_append(database_file, path, path_length);
+}
+
+static z_Database db;
+
+int main(int argc, char** argv)
+{
+    z_trace_init();
+
+    if (argc == 3 && !strcmp(argv[1], Z_HOOK)) {
+        enum z_Result result = z_hook_(argv[2]);
+        if (result != Z_BAD_STRING) {
+            return result == Z_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    Arena arena = {0};
+    Arena scratch = {0};
+    if (!z_arenas_new(&arena, &scratch, argc == 2 && !strcmp(argv[1], Z_DAEMON))) {
+        return EXIT_FAILURE;
+    }
+    arena_stats_name(&arena, "arena");
+    arena_stats_name(&scratch, "scratch");
+
+    char location_buffer[PATH_MAX];
+    Str location = z_database_location(location_buffer, sizeof(location_buffer));
+    if (!location.value) {
+        fputs("z: database location is too long.\n", stderr);
+        arena_free(&arena);
+        arena_free(&scratch);
+        return EXIT_FAILURE;
+    }
+
+    size_t* arg_lens = arena_malloc(&scratch, (size_t)argc + 1, size_t);
+    for (int i = 0; i < argc; ++i) {
+        arg_lens[i] = strlen(argv[i]) + 1;
+    }
+
+    enum z_Load level = z_load_level(argc, argv, arg_lens);
+    if (argc == 3 && estrcmp(argv[1], arg_lens[1], Z_INIT, sizeof(Z_INIT))) {
+        int result = z_shell_init(argv[2], arg_lens[2]);
+        arena_free(&arena);
+        arena_free(&scratch);
+        return result;
+    }
+    if (argc == 2 && estrcmp(argv[1], arg_lens[1], Z_DAEMON, sizeof(Z_DAEMON))) {
+        enum z_Result result = z_daemon_run(&location, &db, &arena, scratch);
+        arena_free(&arena);
+        arena_free(&scratch);
+        return result == Z_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // a running daemon already has the database in memory, fall back to the file if there isn't one. Everything which
+    // records a visit goes through it when it is running, otherwise its next flush would overwrite the visit
+    bool jump = level == Z_LOAD_FULL && argc == 2 && !z_is_command(argv[1], arg_lens[1]);
+    bool keywords = argc > 2 && !z_is_command(argv[1], arg_lens[1]);
+    bool query = estrcmp(argv[1], arg_lens[1], Z_QUERY, sizeof(Z_QUERY));
+    if (jump || keywords || (query && level == Z_LOAD_FULL) || (argc == 3 && level == Z_LOAD_ENTRIES)) {
+        int fd = z_daemon_connect();
+        if (fd != -1) {
+            enum z_Result result = z_daemon_(fd, argc, argv, arg_lens, scratch);
+            close(fd);
+            if (result != Z_FILE_ERROR) {
+                arena_free(&arena);
+                arena_free(&scratch);
+                return result == Z_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+        }
+    }
+
+    // load the database while looking at the filesystem, so a jump costs the slower of the two rather than both
+    z_Loader loader = {.result = Z_SUCCESS};
+    if (level == Z_LOAD_NONE) {
+        db.loaded = Z_LOAD_NONE;
+    }
+    else {
+        z_init_async(&loader, &location, &db, &arena, level);
+    }
+
+    z_Probe probe = {0};
+    char cwd[PATH_MAX] = {0};
+    if (jump) {
+        if (!getcwd(cwd, PATH_MAX)) {
+            perror(RED "z: Could not load cwd information" RESET);
+            jump = false;
+        }
+        else {
+            z_probe(argv[1], arg_lens[1], cwd, NULL, &probe, &scratch);
+        }
+    }
+
+    if (z_init_wait(&loader) != Z_SUCCESS) {
+        arena_free(&arena);
+        arena_free(&scratch);
+        return EXIT_FAILURE;
+    }
+
+    int result = EXIT_SUCCESS;
+    if (jump) {
+        z_with_probe(argv[1], arg_lens[1], cwd, &probe, &db, &arena, scratch);
+    }
+    else {
+        result = z_(&db, argv, arg_lens, &arena, &scratch);
+    }
+
+    if (z_exit(&db) != Z_SUCCESS) {
+        result = EXIT_FAILURE;
+    }
+
+    arena_free(&arena);
+    arena_free(&scratch);
+    return result;
 }
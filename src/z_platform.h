@@ -9,5 +9,8 @@
 #ifndef MAX_INPUT
 #define MAX_INPUT PATH_MAX
 #endif /* !MAX_INPUT */
+#ifndef NAME_MAX
+#define NAME_MAX 255
+#endif /* !NAME_MAX */
 #endif /* __linux__ && !__MSYS@__ */
 
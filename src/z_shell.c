@@ -0,0 +1,93 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* This project is licensed under GNU GPLv3 */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ecolors.h"
+#include "str.h"
+#include "z_shell.h"
+
+/* The generated code costs one fork/exec per jump, `z query` both finds the directory and records the visit.
+ * The hook only runs z when the cwd actually changed, and the z function marks where it is going so the hook doesn't
+ * record the jump a second time. Commands other than jumps go straight to the binary.
+ */
+#define Z_SHELL_COMMANDS "add|rm|remove|print|count|help|daemon|init|hook|query|stats"
+
+#define Z_SHELL_POSIX_FUNCTIONS                                                                                        \
+    "__z_pwd=\"$PWD\"\n"                                                                                               \
+    "__z_hook() {\n"                                                                                                   \
+    "    if [ \"$PWD\" != \"$__z_pwd\" ]; then\n"                                                                      \
+    "        __z_pwd=\"$PWD\"\n"                                                                                       \
+    "        command z hook \"$PWD\"\n"                                                                                \
+    "    fi\n"                                                                                                         \
+    "}\n"                                                                                                              \
+    "z() {\n"                                                                                                          \
+    "    case \"$1\" in\n"                                                                                             \
+    "        " Z_SHELL_COMMANDS ") command z \"$@\" ;;\n"                                                              \
+    "        *)\n"                                                                                                     \
+    "            local __z_dir\n"                                                                                      \
+    "            __z_dir=\"$(command z query \"$@\")\" && __z_pwd=\"$__z_dir\" && cd -- \"$__z_dir\"\n"                \
+    "            ;;\n"                                                                                                 \
+    "    esac\n"                                                                                                       \
+    "}\n"
+
+#define Z_SHELL_BASH                                                                                                   \
+    Z_SHELL_POSIX_FUNCTIONS                                                                                            \
+    "case \";${PROMPT_COMMAND[*]};\" in\n"                                                                             \
+    "    *\";__z_hook;\"*) ;;\n"                                                                                       \
+    "    *) PROMPT_COMMAND=\"__z_hook${PROMPT_COMMAND:+;$PROMPT_COMMAND}\" ;;\n"                                       \
+    "esac\n"
+
+#define Z_SHELL_ZSH                                                                                                    \
+    Z_SHELL_POSIX_FUNCTIONS                                                                                            \
+    "autoload -Uz add-zsh-hook\n"                                                                                      \
+    "add-zsh-hook chpwd __z_hook\n"
+
+#define Z_SHELL_FISH                                                                                                   \
+    "set -g __z_pwd $PWD\n"                                                                                            \
+    "function __z_hook --on-variable PWD\n"                                                                            \
+    "    if test \"$PWD\" != \"$__z_pwd\"\n"                                                                           \
+    "        set -g __z_pwd $PWD\n"                                                                                    \
+    "        command z hook $PWD\n"                                                                                    \
+    "    end\n"                                                                                                        \
+    "end\n"                                                                                                            \
+    "function z\n"                                                                                                     \
+    "    switch \"$argv[1]\"\n"                                                                                        \
+    "        case add rm remove print count help daemon init hook query stats\n"                                       \
+    "            command z $argv\n"                                                                                    \
+    "        case '*'\n"                                                                                               \
+    "            set -l __z_dir (command z query $argv); or return\n"                                                  \
+    "            set -g __z_pwd $__z_dir\n"                                                                            \
+    "            cd $__z_dir\n"                                                                                        \
+    "    end\n"                                                                                                        \
+    "end\n"
+
+#define Z_SHELL_UNSUPPORTED_MESSAGE "z: init supports bash, zsh and fish.\n"
+
+#define Z_SHELL_WRITE(str)                                                                                             \
+    if (write(STDOUT_FILENO, str, sizeof(str) - 1) == -1) {                                                            \
+        perror(RED "z: error writing shell integration." RESET);                                                       \
+        return EXIT_FAILURE;                                                                                           \
+    }                                                                                                                  \
+    return EXIT_SUCCESS;
+
+[[nodiscard]]
+int z_shell_init(char* restrict shell, size_t shell_length)
+{
+    if (shell && estrcmp(shell, shell_length, "bash", sizeof("bash"))) {
+        Z_SHELL_WRITE(Z_SHELL_BASH);
+    }
+    if (shell && estrcmp(shell, shell_length, "zsh", sizeof("zsh"))) {
+        Z_SHELL_WRITE(Z_SHELL_ZSH);
+    }
+    if (shell && estrcmp(shell, shell_length, "fish", sizeof("fish"))) {
+        Z_SHELL_WRITE(Z_SHELL_FISH);
+    }
+
+    fputs(Z_SHELL_UNSUPPORTED_MESSAGE, stderr);
+    return EXIT_FAILURE;
+}
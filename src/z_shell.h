@@ -0,0 +1,11 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* This project is licensed under GNU GPLv3 */
+
+#pragma once
+
+#include <stddef.h>
+
+/* z_shell_init
+ * Write the z function and cd hook for shell to stdout, for `eval "$(z init bash)"` and the like.
+ */
+int z_shell_init(char* restrict shell, size_t shell_length);
@@ -0,0 +1,161 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* This project is licensed under GNU GPLv3 */
+
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // for clock_gettime
+#endif                  /* ifndef _DEFAULT_SOURCE */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "z_trace.h"
+
+typedef struct {
+    const char* name;
+    uint64_t start; // nanoseconds on the monotonic clock
+    uint64_t end;
+    uint32_t thread;
+} z_Trace_Span;
+
+bool z_trace_enabled;
+
+static struct {
+    char* file; // NULL to print the line to stderr
+    atomic_size_t count;
+    atomic_uint threads;
+    z_Trace_Span spans[Z_TRACE_SPANS];
+} z_trace__;
+
+static pthread_once_t z_trace_once = PTHREAD_ONCE_INIT;
+
+// numbered from 1 in the order threads first record a span, the tid of their events in the JSON
+static thread_local uint32_t z_trace_thread;
+
+uint64_t z_trace_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void z_trace_record__(const char* restrict name, uint64_t start)
+{
+    uint64_t end = z_trace_now();
+    if (!z_trace_thread) {
+        z_trace_thread = atomic_fetch_add(&z_trace__.threads, 1) + 1;
+    }
+
+    size_t i = atomic_fetch_add(&z_trace__.count, 1);
+    if (i >= Z_TRACE_SPANS) {
+        return;
+    }
+    z_trace__.spans[i] = (z_Trace_Span){.name = name, .start = start, .end = end, .thread = z_trace_thread};
+}
+
+static void z_trace_exit(void)
+{
+    z_trace_flush();
+}
+
+static void z_trace_init_once(void)
+{
+    char* value = getenv(Z_TRACE);
+    if (!value || !*value || !strcmp(value, "0")) {
+        return;
+    }
+
+    z_trace__.file = strcmp(value, "1") ? value : NULL;
+    z_trace_enabled = true;
+    atexit(z_trace_exit);
+}
+
+void z_trace_init(void)
+{
+    pthread_once(&z_trace_once, z_trace_init_once);
+}
+
+static int z_trace_span_compare(const void* lhs, const void* rhs)
+{
+    const z_Trace_Span* l = lhs;
+    const z_Trace_Span* r = rhs;
+    return (l->start > r->start) - (l->start < r->start);
+}
+
+static void z_trace_line(z_Trace_Span* restrict spans, size_t count, size_t dropped)
+{
+    uint64_t end = 0;
+    fputs("z trace:", stderr);
+    for (size_t i = 0; i < count; ++i) {
+        fprintf(stderr, " %s=%.3fms", spans[i].name, (double)(spans[i].end - spans[i].start) / 1e6);
+        if (spans[i].end > end) {
+            end = spans[i].end;
+        }
+    }
+    fprintf(stderr, " total=%.3fms", (double)(end - spans[0].start) / 1e6);
+    if (dropped) {
+        fprintf(stderr, " dropped=%zu", dropped);
+    }
+    fputc('\n', stderr);
+}
+
+/* z_trace_json
+ * Append the spans as complete events in the JSON array format. The array is opened when the file is empty and never
+ * closed, trace viewers accept a missing ] and trailing comma so every process can keep appending to the same file.
+ */
+static void z_trace_json(z_Trace_Span* restrict spans, size_t count, size_t dropped)
+{
+    FILE* file = fopen(z_trace__.file, "a");
+    if (!file) {
+        perror("z: couldn't open Z_TRACE file");
+        return;
+    }
+
+    if (fseek(file, 0, SEEK_END) != -1 && !ftell(file)) {
+        fputs("[\n", file);
+    }
+
+    long pid = (long)getpid();
+    for (size_t i = 0; i < count; ++i) {
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%u},\n",
+                spans[i].name, (double)spans[i].start / 1e3, (double)(spans[i].end - spans[i].start) / 1e3, pid,
+                spans[i].thread);
+    }
+    if (dropped) {
+        fprintf(file, "{\"name\":\"dropped %zu spans\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":%ld},\n",
+                dropped, (double)spans[count - 1].start / 1e3, pid);
+    }
+
+    if (fclose(file) == EOF) {
+        perror("z: couldn't write Z_TRACE file");
+    }
+}
+
+void z_trace_flush(void)
+{
+    if (!z_trace_enabled) {
+        return;
+    }
+
+    size_t count = atomic_exchange(&z_trace__.count, 0);
+    if (!count) {
+        return;
+    }
+    size_t dropped = 0;
+    if (count > Z_TRACE_SPANS) {
+        dropped = count - Z_TRACE_SPANS;
+        count = Z_TRACE_SPANS;
+    }
+
+    qsort(z_trace__.spans, count, sizeof(z_Trace_Span), z_trace_span_compare);
+    if (z_trace__.file) {
+        z_trace_json(z_trace__.spans, count, dropped);
+    }
+    else {
+        z_trace_line(z_trace__.spans, count, dropped);
+    }
+}
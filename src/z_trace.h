@@ -0,0 +1,57 @@
+/* Copyright z (C) by Alex Eski 2025 */
+/* z_trace: timings of each phase of a jump, turned on at runtime with the Z_TRACE environment variable */
+/* This project is licensed under GNU GPLv3 */
+
+#pragma once
+#ifndef Z_TRACE_H_
+#define Z_TRACE_H_
+
+#include <stdint.h>
+
+/* Z_TRACE=1 prints one line of span durations to stderr when the process exits, or the daemon finishes a request.
+ * Any other value is a file the spans are appended to in Chrome's trace event format, open it in chrome://tracing
+ * or ui.perfetto.dev. Spans are kept in order of when they started so nested spans follow their parent.
+ * Unset, empty or 0 turns tracing off, leaving a branch on z_trace_enabled per span.
+ */
+#define Z_TRACE "Z_TRACE"
+
+// spans recorded between flushes, any more are dropped and counted
+#ifndef Z_TRACE_SPANS
+#define Z_TRACE_SPANS 256
+#endif /* !Z_TRACE_SPANS */
+
+extern bool z_trace_enabled;
+
+/* z_trace_init
+ * Read Z_TRACE, only the first call does anything. Call before starting any threads which record spans.
+ */
+void z_trace_init(void);
+
+uint64_t z_trace_now(void);
+
+void z_trace_record__(const char* restrict name, uint64_t start);
+
+/* z_trace_begin
+ * The start of a span to pass to z_trace_end, 0 when tracing is off.
+ */
+static inline uint64_t z_trace_begin(void)
+{
+    return z_trace_enabled ? z_trace_now() : 0;
+}
+
+/* z_trace_end
+ * Record the span called name from start until now. name must outlive the next flush, use string literals.
+ */
+static inline void z_trace_end(const char* restrict name, uint64_t start)
+{
+    if (z_trace_enabled) {
+        z_trace_record__(name, start);
+    }
+}
+
+/* z_trace_flush
+ * Write the spans recorded so far and start over. Not thread safe, call once the threads recording spans are done.
+ */
+void z_trace_flush(void);
+
+#endif // !Z_TRACE_H_